@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+
+#include "audio_queue.h"
+#include "telemetry.h"
+#include "types.h"
+
+enum AudioLatencyMode
+{
+  AudioLatency_Low = 0, // Live register tweaking: small buffer, heard right away
+  AudioLatency_Deep,    // Slow simulations: large buffer, rides out long stalls
+};
+
+// The consumer side of an AudioQueue, for the audio callback. It keeps a jitter buffer of queued
+// frames whose target depth adapts to how steadily the simulation delivers: an underrun or a near
+// miss deepens it, and a long stretch with plenty to spare shrinks it back towards the mode's
+// minimum. The queue's capacity is held at the target, so a fast simulation can't run ahead and add
+// latency. When the fill drops below 3/4 of the target, playback is slowed by up to MaxSlowdown with
+// a linear resampler, giving the simulation time to catch up before it comes to a dropout.
+//
+// render() is real-time safe: no locks, allocation or I/O. Each consume wakes the producer through
+// the queue's consume event, which is lock-free and only signals a semaphore when the simulation is
+// asleep waiting for room; render() consumes at most twice, when it primes and when it resamples.
+// Everything else may be called from any thread.
+class AudioOutput
+{
+public:
+  static constexpr u32 SampleRate = 32000;
+  static constexpr double MaxSlowdown = 0.005;
+
+  explicit AudioOutput(AudioQueue *queue, AudioLatencyMode mode = AudioLatency_Low)
+      : m_queue(queue), m_requested_mode(mode)
+  {
+    apply_mode(mode);
+  }
+
+  // Takes effect at the next render()
+  void setLatencyMode(AudioLatencyMode mode) { m_requested_mode = mode; }
+  AudioLatencyMode getLatencyMode() const { return m_requested_mode; }
+
+  const AudioTelemetry &getTelemetry() const { return m_telemetry; }
+
+  // Fills 'out' with 'num_frames' interleaved L/R frames
+  void render(s16 *out, u32 num_frames)
+  {
+    const AudioLatencyMode mode = m_requested_mode;
+    if (mode != m_mode)
+      apply_mode(mode);
+
+    const u32 available = m_queue->availableFrames();
+    m_telemetry.callbacks.fetch_add(1, std::memory_order_relaxed);
+    m_telemetry.frames_played.fetch_add(num_frames, std::memory_order_relaxed);
+    m_telemetry.fill_frames.store(available, std::memory_order_relaxed);
+    m_window_min_fill = std::min(m_window_min_fill, available);
+    m_fill = m_fill + (available - m_fill) * FillSmoothing;
+
+    // After an underrun, wait for most of the target to be queued up again
+    if (!m_primed)
+    {
+      if (available < m_target - m_target / 4)
+      {
+        memset(out, 0, num_frames * 2 * sizeof(s16));
+        return;
+      }
+      s16 first[4];
+      m_queue->consumeFrames(first, 2);
+      std::copy(first, first + 2, m_frame_a);
+      std::copy(first + 2, first + 4, m_frame_b);
+      m_phase = 0;
+      m_fill = available;
+      m_primed = true;
+    }
+
+    // Slow down as the fill drops from 3/4 of the target to 1/4 of it
+    const double behind = std::clamp((0.75 - m_fill / m_target) * 2.0, 0.0, 1.0);
+    const double rate = 1.0 - MaxSlowdown * behind;
+    const u64 step = (u64)(rate * PhaseOne);
+    m_telemetry.rate.store((float)rate, std::memory_order_relaxed);
+
+    m_window_frames += num_frames;
+    while (num_frames)
+    {
+      const u32 chunk = std::min(num_frames, ChunkFrames);
+      if (!resample(out, chunk, step))
+      {
+        memset(out, 0, num_frames * 2 * sizeof(s16));
+        underrun();
+        return;
+      }
+      out += chunk * 2;
+      num_frames -= chunk;
+    }
+    adapt();
+  }
+
+private:
+  static constexpr u32 ChunkFrames = 256;
+  static constexpr u64 PhaseOne = 1ull << 32;
+  static constexpr double FillSmoothing = 0.1;
+
+  // How often the target is reconsidered, in output frames
+  static constexpr u32 AdaptWindow = SampleRate;
+
+  struct ModeLimits
+  {
+    u32 min_frames;
+    u32 initial_frames;
+    u32 max_frames;
+  };
+
+  static ModeLimits limits(AudioLatencyMode mode)
+  {
+    if (mode == AudioLatency_Deep)
+      return {4096, 8192, AudioQueue::FrameCount - 1024};
+    return {1536, 2048, 4096};
+  }
+
+  void apply_mode(AudioLatencyMode mode)
+  {
+    m_mode = mode;
+    set_target(limits(mode).initial_frames);
+  }
+
+  void set_target(u32 frames)
+  {
+    const ModeLimits mode_limits = limits(m_mode);
+    m_target = std::clamp(frames, mode_limits.min_frames, mode_limits.max_frames);
+    m_telemetry.target_frames.store(m_target, std::memory_order_relaxed);
+    m_queue->setCapacity(m_target);
+    m_window_frames = 0;
+    m_window_min_fill = AudioQueue::FrameCount;
+  }
+
+  // Produces 'num_frames' frames at 'step' input frames per output frame (32.32 fixed point),
+  // interpolating between m_frame_a and m_frame_b. Consumes nothing and returns false if the queue
+  // doesn't hold enough frames.
+  bool resample(s16 *out, u32 num_frames, u64 step)
+  {
+    const u32 needed = (u32)((m_phase + num_frames * step) >> 32);
+    if (m_queue->availableFrames() < needed)
+      return false;
+    m_queue->consumeFrames(m_input.data(), needed);
+
+    u32 next = 0;
+    for (u32 i = 0; i < num_frames; ++i)
+    {
+      const s32 t = (s32)(m_phase >> 17); // 15 bit fraction
+      out[2 * i] = (s16)(m_frame_a[0] + (((m_frame_b[0] - m_frame_a[0]) * t) >> 15));
+      out[2 * i + 1] = (s16)(m_frame_a[1] + (((m_frame_b[1] - m_frame_a[1]) * t) >> 15));
+
+      m_phase += step;
+      for (; m_phase >= PhaseOne; m_phase -= PhaseOne, ++next)
+      {
+        m_frame_a[0] = m_frame_b[0];
+        m_frame_a[1] = m_frame_b[1];
+        m_frame_b[0] = m_input[2 * next];
+        m_frame_b[1] = m_input[2 * next + 1];
+      }
+    }
+    return true;
+  }
+
+  void underrun()
+  {
+    m_telemetry.underruns.fetch_add(1, std::memory_order_relaxed);
+    m_primed = false;
+    set_target(m_target * 2);
+  }
+
+  // Deepen the buffer after a near miss, and shrink it after a window with plenty to spare
+  void adapt()
+  {
+    if (m_window_frames < AdaptWindow)
+      return;
+    if (m_window_min_fill < m_target / 8)
+      set_target(m_target + m_target / 4);
+    else if (m_window_min_fill > m_target / 2)
+      set_target(m_target - m_target / 8);
+    else
+      set_target(m_target);
+  }
+
+  AudioQueue *const m_queue;
+  std::atomic<AudioLatencyMode> m_requested_mode;
+  AudioTelemetry m_telemetry;
+
+  // Callback only
+  u32 m_target = 0;
+  AudioLatencyMode m_mode = AudioLatency_Low;
+  bool m_primed = false;
+  double m_fill = 0;
+  u32 m_window_frames = 0;
+  u32 m_window_min_fill = AudioQueue::FrameCount;
+  u64 m_phase = 0;
+  s16 m_frame_a[2] = {};
+  s16 m_frame_b[2] = {};
+  std::array<s16, (ChunkFrames + 2) * 2> m_input = {};
+};
@@ -1,56 +1,107 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <cstring>
 #include <vector>
 
+#include "sim_event.h"
 #include "types.h"
 
+// Ring of interleaved L/R frames between one producer (the simulation thread) and one consumer
+// (the audio callback). Each side owns one index and only reads the other's, so acquire/release
+// ordering is enough, and the indices live on separate cache lines so the two threads don't fight
+// over one. Bulk pushes and consumes are at most two memcpys, split where the ring wraps.
 class AudioQueue
 {
 public:
   static constexpr u32 SampleCount = (4096 * 4) * 2;
+  static constexpr u32 FrameCount = SampleCount / 2;
   using SampleType = s16;
 
-  // head = no data, but would be the next location
-  // tail = points to oldest data
-  // if head==tail, empty
+  static_assert((FrameCount & (FrameCount - 1)) == 0, "FrameCount must be a power of two");
+
+  // head = frames ever pushed, tail = frames ever consumed. Both only grow, and are masked into
+  // the ring when indexing it. If head==tail, empty.
 
   AudioQueue()
   {
     sample_data.resize(SampleCount);
   }
 
-  bool isFull() const
+  // Safe from either side: a stale view of the other index only ever underestimates the free
+  // space (producer) or the available frames (consumer).
+  u32 availableFrames() const
   {
-    const u32 current_entries = head - tail;
-    return current_entries >= SampleCount;
+    return (u32)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
   }
+  u32 freeFrames() const
+  {
+    const u32 limit = capacity.load(std::memory_order_relaxed);
+    const u32 available = availableFrames();
+    return available < limit ? limit - available : 0;
+  }
+  bool isFull() const { return freeFrames() == 0; }
+  bool isEmpty() const { return availableFrames() == 0; }
 
-  bool isEmpty() const { return head == tail; }
-
+  // Producer side
   void push(SampleType left, SampleType right)
   {
-    assert(!isFull());
-    sample_data[head % SampleCount] = left;
-    sample_data[(head + 1) % SampleCount] = right;
-    head += 2;
+    const SampleType frame[2] = {left, right};
+    pushFrames(frame, 1);
   }
 
-  u32 availableFrames() const { return (head - tail) / 2; }
+  void pushFrames(const SampleType *src, u32 num_frames)
+  {
+    const u64 h = head.load(std::memory_order_relaxed);
+    assert(FrameCount - (u32)(h - tail.load(std::memory_order_acquire)) >= num_frames);
+
+    const u32 start = (u32)h & (FrameCount - 1);
+    const u32 first = std::min(num_frames, FrameCount - start);
+    memcpy(&sample_data[start * 2], src, first * 2 * sizeof(SampleType));
+    memcpy(&sample_data[0], src + first * 2, (num_frames - first) * 2 * sizeof(SampleType));
+
+    head.store(h + num_frames, std::memory_order_release);
+  }
 
+  // Consumer side
   void consumeFrames(SampleType *dst, u32 num_frames)
   {
-    assert(availableFrames() >= num_frames);
-    // TODO : 1 or 2 memcpys
-    for (u32 i = 0; i < 2 * num_frames; ++i)
-      *dst++ = sample_data[(tail + i) % SampleCount]; // i even=left, odd=right
+    const u64 t = tail.load(std::memory_order_relaxed);
+    assert((u32)(head.load(std::memory_order_acquire) - t) >= num_frames);
 
-    tail += num_frames * 2;
+    const u32 start = (u32)t & (FrameCount - 1);
+    const u32 first = std::min(num_frames, FrameCount - start);
+    memcpy(dst, &sample_data[start * 2], first * 2 * sizeof(SampleType));
+    memcpy(dst + first * 2, &sample_data[0], (num_frames - first) * 2 * sizeof(SampleType));
+
+    tail.store(t + num_frames, std::memory_order_release);
+
+    if (SimEvent *event = consume_event.load(std::memory_order_acquire))
+      event->notify();
   }
 
+  // Notified after every consume, so that a producer waiting for room can sleep on it. notify() is
+  // lock-free and only wakes a producer that is asleep, so this is fine on the audio callback. The
+  // event must stay alive until it is unset and the consumer is known not to be mid-consume.
+  void setConsumeEvent(SimEvent *event) { consume_event.store(event, std::memory_order_release); }
+
+  // How many frames the producer may queue up, at most FrameCount. Set by the consumer to bound its
+  // latency; lowering it below what is already queued just holds the producer off until it drains.
+  void setCapacity(u32 num_frames)
+  {
+    assert(num_frames <= FrameCount);
+    capacity.store(num_frames, std::memory_order_relaxed);
+  }
+  u32 getCapacity() const { return capacity.load(std::memory_order_relaxed); }
+
 private:
+  static constexpr size_t CacheLineSize = 64;
+
   std::vector<SampleType> sample_data;
-  std::atomic<u64> head = {};
-  std::atomic<u64> tail = {};
+  alignas(CacheLineSize) std::atomic<u64> head = {};
+  alignas(CacheLineSize) std::atomic<u64> tail = {};
+  std::atomic<SimEvent *> consume_event = {};
+  std::atomic<u32> capacity = FrameCount;
 };
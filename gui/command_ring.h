@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <utility>
+
+#include "types.h"
+
+// Bounded lock-free queue for many producers (GUI controls, from any thread) and one consumer (the
+// simulation thread). Each slot carries a sequence number saying whose turn it is: producers claim a
+// slot by advancing head with a CAS, fill it and hand it over by bumping its sequence; the consumer
+// takes slots in order once their sequence says they are filled. Nobody ever waits on a lock, so a
+// producer can't stall the consumer, and a half-written command is never seen.
+template <class T, u32 Capacity>
+class CommandRing
+{
+public:
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  CommandRing()
+  {
+    for (u32 i = 0; i < Capacity; ++i)
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  // Returns false, leaving 'value' untouched, if the ring is full
+  bool push(T &&value)
+  {
+    u64 pos = head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Slot &slot = slots[pos & (Capacity - 1)];
+      const u64 sequence = slot.sequence.load(std::memory_order_acquire);
+      if (sequence == pos)
+      {
+        if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          slot.value = std::move(value);
+          slot.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (sequence < pos)
+      {
+        return false; // Still holds a command from the last lap
+      }
+      else
+      {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Consumer only. Returns false if there is nothing ready to take.
+  bool pop(T &value)
+  {
+    Slot &slot = slots[tail & (Capacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+      return false;
+
+    value = std::move(slot.value);
+    slot.sequence.store(tail + Capacity, std::memory_order_release);
+    ++tail;
+    return true;
+  }
+
+  // Consumer only. Whether the next command is ready to pop.
+  bool ready() const
+  {
+    return slots[tail & (Capacity - 1)].sequence.load(std::memory_order_acquire) == tail + 1;
+  }
+
+private:
+  static constexpr size_t CacheLineSize = 64;
+
+  struct Slot
+  {
+    std::atomic<u64> sequence;
+    T value;
+  };
+
+  std::array<Slot, Capacity> slots;
+  alignas(CacheLineSize) std::atomic<u64> head = {};
+  alignas(CacheLineSize) u64 tail = 0;
+};
@@ -1,50 +1,119 @@
 #include <cstring>
+#include <memory>
 #include "controller.h"
+#include "APUFiles.h"
 
-void Controller::loadSPCFromFile(const char *file_path)
+bool Controller::loadMemoryFromFile(const char *file_path)
+{
+  auto file = std::make_shared<MappedFile>();
+  if (!file->open(file_path) || !file->size())
+  {
+    printf("Failed to load %s\n", file_path);
+    return false;
+  }
+  const u32 size = (u32)std::min<u64>(file->size(), MemoryState::shared_memory_size);
+  return setMemorySpan(0, size, file->data(), file);
+}
+
+bool Controller::loadSPCFromFile(const char *file_path)
+{
+  auto spc = std::make_shared<SPCFile>();
+  if (!spc->open(file_path))
+  {
+    printf("Failed to load %s: %s\n", file_path, spc->error());
+    return false;
+  }
+
+  const SPCFile::ID666 &tag = spc->tag();
+  if (!tag.title.empty() || !tag.game.empty())
+    printf("Loaded %.*s (%.*s)\n", (int)tag.title.size(), tag.title.data(), (int)tag.game.size(), tag.game.data());
+
+  APUState state = {};
+  state.PC = spc->PC();
+  state.A = spc->A();
+  state.X = spc->X();
+  state.Y = spc->Y();
+  state.PSW = spc->PSW();
+  state.SP = spc->SP();
+  state.ram = spc->ram();
+  state.dsp_registers = spc->dsp_registers();
+  state.storage = spc;
+  return loadState(state);
+}
+
+bool Controller::setDSPRegisters(const u8 values[128])
 {
-  // https://wiki.superfamicom.org/spc-and-rsn-file-format
-  auto file = fopen(file_path, "rb");
-  fseek(file, 0, SEEK_END);
-  const u32 file_size = ftell(file);
-  fseek(file, 0, SEEK_SET);
-  assert(file_size >= 0x10180);
-
-  // Read entire file contents
-  std::vector<u8> data(file_size);
-  fread(&data[0], sizeof(u8), file_size, file);
-  fclose(file);
-
-#define LOAD(dst, offset, size) memcpy(dst, &data[offset], size);
-  // Load SPC700 Registers
-  u16 PC;
-  u8 A, X, Y, PSW, SP;
-  LOAD(&PC, 0x25, 2)
-  LOAD(&A, 0x27, 1)
-  LOAD(&X, 0x28, 1)
-  LOAD(&Y, 0x29, 1)
-  LOAD(&PSW, 0x2A, 1)
-  LOAD(&SP, 0x2B, 1)
-  setCPURegister(CPURegisterIndex_A, A);
-  setCPURegister(CPURegisterIndex_X, X);
-  setCPURegister(CPURegisterIndex_Y, Y);
-  setCPURegister(CPURegisterIndex_SP, SP);
-  setCPURegister(CPURegisterIndex_PSW, PSW);
-  setCPURegister(CPURegisterIndex_PCHigh, PC >> 8);
-  setCPURegister(CPURegisterIndex_PCLow, PC & 0xFF);
-
-  // Load RAM
-  std::array<u8, 64 * 1024> ram;
-  LOAD(ram.data(), 0x100, ram.size())
-  setMemorySpan(0, ram.size(), ram.data());
-
-  // Load DSP Registers
-  u8 dsp_regs[128];
-  LOAD(&dsp_regs[0], 0x10100, 128)
   for (u8 i = 0; i < 128; ++i)
-    setDSPRegister(i, dsp_regs[i]);
-    
-#undef LOAD
+    setDSPRegister(i, values[i]);
+  return true;
+}
+
+bool Controller::loadState(const APUState &state)
+{
+  setCPURegister(CPURegisterIndex_A, state.A);
+  setCPURegister(CPURegisterIndex_X, state.X);
+  setCPURegister(CPURegisterIndex_Y, state.Y);
+  setCPURegister(CPURegisterIndex_SP, state.SP);
+  setCPURegister(CPURegisterIndex_PSW, state.PSW);
+  setCPURegister(CPURegisterIndex_PCHigh, state.PC >> 8);
+  setCPURegister(CPURegisterIndex_PCLow, state.PC & 0xFF);
+  setMemorySpan(0, MemoryState::shared_memory_size, state.ram, state.storage);
+  return setDSPRegisters(state.dsp_registers);
+}
+
+void Controller::loadDefaultDSPRegisters()
+{
+  u8 regs[128] = {};
+  const u8 max_volume = 0x7F;
+  const u8 voice_volume = max_volume / 8;
+
+  regs[DSPRegister_VOLL0] = voice_volume;
+  regs[DSPRegister_VOLL1] = voice_volume;
+  regs[DSPRegister_VOLL2] = voice_volume;
+  regs[DSPRegister_VOLL3] = voice_volume;
+  regs[DSPRegister_VOLL4] = voice_volume;
+  regs[DSPRegister_VOLL5] = voice_volume;
+  regs[DSPRegister_VOLL6] = voice_volume;
+  regs[DSPRegister_VOLL7] = voice_volume;
+
+  regs[DSPRegister_VOLR0] = voice_volume;
+  regs[DSPRegister_VOLR1] = voice_volume;
+  regs[DSPRegister_VOLR2] = voice_volume;
+  regs[DSPRegister_VOLR3] = voice_volume;
+  regs[DSPRegister_VOLR4] = voice_volume;
+  regs[DSPRegister_VOLR5] = voice_volume;
+  regs[DSPRegister_VOLR6] = voice_volume;
+  regs[DSPRegister_VOLR7] = voice_volume;
+
+  const u16 vpitch = 4096 / 4; // nominal
+  const u8 PL = vpitch & 0xFF;
+  const u8 PH = (vpitch >> 8) & 0x3F;
+
+  regs[DSPRegister_PL0] = PL;
+  regs[DSPRegister_PL1] = PL;
+  regs[DSPRegister_PL2] = PL;
+  regs[DSPRegister_PL3] = PL;
+  regs[DSPRegister_PL4] = PL;
+  regs[DSPRegister_PL5] = PL;
+  regs[DSPRegister_PL6] = PL;
+  regs[DSPRegister_PL7] = PL;
+
+  regs[DSPRegister_PH0] = PH;
+  regs[DSPRegister_PH1] = PH;
+  regs[DSPRegister_PH2] = PH;
+  regs[DSPRegister_PH3] = PH;
+  regs[DSPRegister_PH4] = PH;
+  regs[DSPRegister_PH5] = PH;
+  regs[DSPRegister_PH6] = PH;
+  regs[DSPRegister_PH7] = PH;
+
+  regs[DSPRegister_MVOLL] = max_volume;
+  regs[DSPRegister_MVOLR] = max_volume;
+
+  // Experimenting with pitch modulation
+  // regs[DSPRegister_PMON] = 0b01000000;
+
+  setDSPRegisters(regs);
 }
 
 const char *dsp_register_names[128] = {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "audio_queue.h"
+#include "telemetry.h"
 #include "types.h"
 
 #include <algorithm>
@@ -37,6 +38,13 @@ enum DSPRegisters {
   #undef DSP_REGISTER
 };
 
+enum SpeedMode
+{
+  SpeedMode_Realtime = 0, // Paced by the audio device, or the wall clock without one
+  SpeedMode_Turbo,        // As fast as the host allows, with the audio decimated to keep up
+  SpeedMode_SlowMotion,   // A fraction of real time, paced by the wall clock, with the audio muted
+};
+
 struct CPUState
 {
   uint8_t A, X, Y, PSW;
@@ -73,6 +81,18 @@ struct DSPState
   u32 major_cycle;
 };
 
+// Everything needed to start the APU from a given point, e.g. as stored in an SPC file. The RAM and
+// DSP register images are borrowed from 'storage' (e.g. the mapped file), which keeps them alive for
+// as long as the state is held onto, such as by a command waiting in a controller's queue.
+struct APUState
+{
+  u16 PC;
+  u8 A, X, Y, PSW, SP;
+  const u8 *dsp_registers; // 128 bytes
+  const u8 *ram;           // 64 KiB
+  std::shared_ptr<const void> storage;
+};
+
 
 
 const char *getDSPRegisterName(u8 register_index);
@@ -93,30 +113,48 @@ public:
   // Set State
   virtual bool setCPURegister(uint8_t registerIndex, uint8_t value) = 0;
   virtual bool setDSPRegister(uint8_t registerIndex, uint8_t value) = 0;
-  virtual bool setMemorySpan(uint16_t addressOffset, uint32_t range, uint8_t *data) = 0;
+  // 'data' is borrowed like an APUState's images: 'storage' keeps it alive until the write has been
+  // applied, so nothing is copied on the way to the simulation thread.
+  virtual bool setMemorySpan(uint16_t addressOffset, uint32_t range, const u8 *data,
+                             std::shared_ptr<const void> storage) = 0;
 
-  void loadMemoryFromFile(const char *file_path)
-  {
-    auto file = fopen(file_path, "rb");
-    fseek(file, 0, SEEK_END);
-    const u32 file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    std::vector<u8> data(file_size);
-    fread(&data[0], sizeof(u8), file_size, file);
-    fclose(file);
+  // Zero-tick state injection: these write the state straight into the simulation rather than
+  // through the register ports, so they take no simulated time and trigger nothing. The defaults
+  // fall back to the setters above, for backends where those are already free.
+  virtual bool setDSPRegisters(const u8 values[128]);
+  virtual bool loadState(const APUState &state);
+
+  // Loads a file to the start of RAM. Anything past 64 KiB is ignored. Returns false if it could not
+  // be loaded.
+  bool loadMemoryFromFile(const char *file_path);
 
-    const u32 size = std::min((u32)(64 * 1024), file_size);
-    setMemorySpan(0, size, &data[0]);
-  }
+  // Loads the whole state in an SPC file, straight from the mapped file. Returns false if it could
+  // not be loaded.
+  bool loadSPCFromFile(const char *file_path);
 
-  void loadSPCFromFile(const char *file_path);
+  // Writes the power-on register values used by the GUI (voice volumes, nominal pitch, main volume),
+  // and zeroes the rest
+  void loadDefaultDSPRegisters();
 
   // Hardware control
   virtual void singleStep() = 0;
   virtual void resume() = 0;
   virtual void stop() = 0;
-  virtual void setSpeed() = 0;
+  // 'factor' is the fraction of real time to run at in SpeedMode_SlowMotion, and ignored otherwise
+  virtual void setSpeed(SpeedMode mode, float factor = 1.0f) = 0;
   virtual void reset() = 0;
 
+  // Checkpoints of the whole simulation state, including RAM. Returns false if the backend does not
+  // support them or the request failed.
+  virtual bool saveSnapshot(const char *) { return false; }
+  virtual bool restoreSnapshot(const char *) { return false; }
+
   virtual uint64_t getCycleCount() const = 0;
+
+  // Fraction of wall time the simulation thread spends simulating rather than sleeping, averaged
+  // over the last half second or so. Backends that never sleep are always busy.
+  virtual float getDutyCycle() { return 1.0f; }
+
+  // Counters kept by the simulation thread, or null if the backend keeps none
+  virtual SimTelemetry *getTelemetry() { return nullptr; }
 };
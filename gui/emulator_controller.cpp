@@ -0,0 +1,351 @@
+#include "emulator_controller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+const unsigned DSP_FRAME_RATE = 32000;
+
+// Frames rendered per call into the model while running freely
+const unsigned FRAMES_PER_BLOCK = 256;
+
+// Frames a wall-clock paced simulation may fall behind by before it gives up catching up
+const uint64_t MAX_PACE_DEBT_FRAMES = DSP_FRAME_RATE / 10;
+
+// How often the GUI is given a fresh DSP state while running. No point outpacing the display.
+const auto DSP_STATE_PERIOD = std::chrono::microseconds(1000000 / 60);
+
+EmulatorController::EmulatorController()
+{
+  loadDefaultDSPRegisters();
+  publish_dsp_state();
+  publish_memory();
+
+  // Kick off the simulation thread
+  m_thread = std::thread([&]()
+                         { sim_thread_func(); });
+}
+
+EmulatorController::~EmulatorController()
+{
+  if (AudioQueue *audio_queue = m_audio_queue)
+    audio_queue->setConsumeEvent(nullptr);
+
+  m_quit = true;
+  m_wake.notify();
+  m_thread.join();
+}
+
+void EmulatorController::setAudioQueue(AudioQueue *audio_queue)
+{
+  if (AudioQueue *old_audio_queue = m_audio_queue.exchange(audio_queue))
+    old_audio_queue->setConsumeEvent(nullptr);
+  if (audio_queue)
+    audio_queue->setConsumeEvent(&m_wake);
+  m_wake.notify();
+}
+
+bool EmulatorController::getCPUState(CPUState *) { return true; }
+bool EmulatorController::getDSPState(DSPState *out)
+{
+  if (!out)
+    return false;
+
+  *out = m_dsp_state.read();
+  return true;
+}
+
+bool EmulatorController::getMemoryState(MemoryState *out)
+{
+  if (!out)
+    return false;
+
+  *out = m_memory_state.read();
+  return true;
+}
+
+// Set State
+bool EmulatorController::setCPURegister(uint8_t registerIndex, uint8_t value) { return true; }
+
+bool EmulatorController::setDSPRegister(uint8_t registerIndex, uint8_t value)
+{
+  push_command(Command_SetDSPRegValue{registerIndex, value});
+  return true;
+}
+
+bool EmulatorController::setMemorySpan(uint16_t addressOffset, uint32_t range, const u8 *data,
+                                       std::shared_ptr<const void> storage)
+{
+  assert(addressOffset < 64 * 1024);
+  assert(addressOffset + range <= 64 * 1024);
+  push_command(Command_WriteRAM{addressOffset, range, data, std::move(storage)});
+  return true;
+}
+
+bool EmulatorController::setDSPRegisters(const u8 values[128])
+{
+  Command_WriteDSPRegisters command;
+  std::copy(values, values + 128, command.values.begin());
+  push_command(std::move(command));
+  return true;
+}
+
+bool EmulatorController::loadState(const APUState &state)
+{
+  push_command(Command_LoadState{state});
+  return true;
+}
+
+// Hardware control
+void EmulatorController::singleStep() { push_command(Command_Run{1}); }
+void EmulatorController::resume() { push_command(Command_Run{-1}); }
+void EmulatorController::stop() { push_command(Command_Run{0}); }
+void EmulatorController::setSpeed(SpeedMode mode, float factor) { push_command(Command_SetSpeed{mode, factor}); }
+void EmulatorController::reset()
+{
+  push_command(Command_Reset{});
+
+  loadDefaultDSPRegisters();
+}
+
+// Never blocks the simulation thread. If the ring is full, the caller waits for it to drain.
+void EmulatorController::push_command(UserCommand command)
+{
+  QueuedCommand queued = {std::move(command), telemetry_now_ns()};
+  while (!m_commands.push(std::move(queued)))
+  {
+    m_wake.notify();
+    std::this_thread::yield();
+  }
+  m_wake.notify();
+}
+
+// Copies what the GUI displays out of the model. Simulation thread only.
+void EmulatorController::publish_dsp_state()
+{
+  DSPState &state = m_dsp_state.back();
+
+  // Samples are rendered whole, so the DSP is always observed at the end of its schedule.
+  state.major_cycle = DSPModel::cycles_per_sample - 1;
+  state.ram_address = m_dsp.voice(DSPState::num_voices - 1).ram_address;
+  state.ram_data = m_memory.shared_memory[state.ram_address];
+
+  memcpy(state.register_values, m_dsp.registers(), sizeof(state.register_values));
+
+  for (u8 i = 0; i < DSPState::num_voices; ++i)
+  {
+    const DSPModel::VoiceStatus voice = m_dsp.voice(i);
+    state.voice[i].fsm_state = voice.state;
+    state.voice[i].decoder_address = voice.ram_address;
+    state.voice[i].decoder_cursor = voice.cursor;
+    state.voice[i].decoder_output = voice.current_output;
+  }
+
+  m_dsp_state.publish();
+  m_telemetry.cycles = m_dsp.sample_count() * DSPModel::cycles_per_sample;
+}
+
+// The DSP only reads RAM, so it only changes through commands. Simulation thread only.
+void EmulatorController::publish_memory()
+{
+  m_memory_state.back() = m_memory;
+  m_memory_state.publish();
+}
+
+// Whether the simulation thread has samples to render: single steps, or free running in turbo, with
+// room in the audio queue for another block, or with samples due by the wall clock.
+bool EmulatorController::can_render(int64_t step_count) const
+{
+  if (step_count > 0)
+    return true;
+  if (step_count == 0)
+    return false;
+  if (m_speed_mode == SpeedMode_Turbo)
+    return true;
+  const AudioQueue *audio_queue = m_audio_queue;
+  if (m_speed_mode == SpeedMode_Realtime && audio_queue)
+    return audio_queue->freeFrames() >= FRAMES_PER_BLOCK;
+  return paced_frames(std::chrono::steady_clock::now()) >= pace_chunk_frames();
+}
+
+// Real time is kept by the audio device when there is one. Without one, and in slow motion, the
+// simulation is paced by the wall clock instead.
+bool EmulatorController::is_paced() const
+{
+  return m_speed_mode == SpeedMode_SlowMotion || (m_speed_mode == SpeedMode_Realtime && !m_audio_queue);
+}
+
+void EmulatorController::restart_pacing()
+{
+  m_pace_start = std::chrono::steady_clock::now();
+  m_pace_frames = 0;
+}
+
+double EmulatorController::paced_frames_per_sec() const
+{
+  const double factor = m_speed_mode == SpeedMode_SlowMotion ? m_speed_factor : 1.0;
+  return factor * DSP_FRAME_RATE;
+}
+
+// Frames that may be rendered at 'now' without getting ahead of the wall clock
+uint64_t EmulatorController::paced_frames(std::chrono::steady_clock::time_point now) const
+{
+  const std::chrono::duration<double> elapsed = now - m_pace_start;
+  const uint64_t allowed = (uint64_t)(elapsed.count() * paced_frames_per_sec());
+  return allowed > m_pace_frames ? allowed - m_pace_frames : 0;
+}
+
+// Paced frames are rendered a millisecond's worth at a time, or one at a time in slow motion, so
+// that the simulation thread wakes up at most about a thousand times a second.
+uint64_t EmulatorController::pace_chunk_frames() const
+{
+  return std::max<uint64_t>(1, (uint64_t)(paced_frames_per_sec() / 1000));
+}
+
+// When the next chunk of frames falls due
+std::chrono::steady_clock::time_point EmulatorController::pace_deadline() const
+{
+  const std::chrono::duration<double> offset((m_pace_frames + pace_chunk_frames()) / paced_frames_per_sec());
+  return m_pace_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset);
+}
+
+// Sleeps until there are samples to render, commands to run, or we are quitting. Everything that
+// can change one of those notifies m_wake: the controls, push_command() and the audio callback after
+// it consumes from the queue. When paced by the wall clock, the sleep ends at the next deadline.
+void EmulatorController::wait_for_work()
+{
+  const int64_t start_ns = telemetry_now_ns();
+  m_telemetry.sleep_start_ns = start_ns;
+  const auto ready = [&]()
+  { return m_quit || m_commands.ready() || can_render(m_step_count); };
+  if (m_step_count < 0 && is_paced())
+    m_wake.wait_until(pace_deadline(), ready);
+  else
+    m_wake.wait(ready);
+  m_telemetry.idle_ns += telemetry_now_ns() - start_ns;
+  m_telemetry.sleep_start_ns = 0;
+}
+
+// Runs every command queued so far, as one batch
+void EmulatorController::run_user_commands()
+{
+  bool memory_changed = false;
+  QueuedCommand queued;
+  while (m_commands.pop(queued))
+  {
+    const uint64_t latency_ns = telemetry_now_ns() - queued.queued_ns;
+    m_telemetry.commands.fetch_add(1, std::memory_order_relaxed);
+    m_telemetry.command_latency_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+    telemetry_max(m_telemetry.command_latency_max_ns, latency_ns);
+
+    const UserCommand &cmd_variant = queued.command;
+    if (std::holds_alternative<Command_SetDSPRegValue>(cmd_variant))
+    {
+      const Command_SetDSPRegValue &cmd = std::get<Command_SetDSPRegValue>(cmd_variant);
+      m_dsp.write_register(cmd.dsp_reg, cmd.reg_value);
+    }
+    else if (std::holds_alternative<Command_WriteRAM>(cmd_variant))
+    {
+      const Command_WriteRAM &cmd = std::get<Command_WriteRAM>(cmd_variant);
+      memcpy(&m_memory.shared_memory[cmd.address], cmd.data, cmd.size);
+      memory_changed = true;
+    }
+    else if (std::holds_alternative<Command_WriteDSPRegisters>(cmd_variant))
+    {
+      const Command_WriteDSPRegisters &cmd = std::get<Command_WriteDSPRegisters>(cmd_variant);
+      for (u8 i = 0; i < 128; ++i)
+        m_dsp.write_register(i, cmd.values[i]);
+    }
+    else if (std::holds_alternative<Command_LoadState>(cmd_variant))
+    {
+      // The model has no CPU, so the CPU registers have nowhere to go
+      const APUState &state = std::get<Command_LoadState>(cmd_variant).state;
+      memcpy(m_memory.shared_memory.data(), state.ram, MemoryState::shared_memory_size);
+      for (u8 i = 0; i < 128; ++i)
+        m_dsp.write_register(i, state.dsp_registers[i]);
+      memory_changed = true;
+    }
+    else if (std::holds_alternative<Command_Run>(cmd_variant))
+    {
+      m_step_count = std::get<Command_Run>(cmd_variant).step_count;
+      restart_pacing();
+    }
+    else if (std::holds_alternative<Command_SetSpeed>(cmd_variant))
+    {
+      const Command_SetSpeed &cmd = std::get<Command_SetSpeed>(cmd_variant);
+      m_speed_mode = cmd.mode;
+      m_speed_factor = std::clamp(cmd.factor, 1e-6f, 1.0f);
+      restart_pacing();
+    }
+    else if (std::holds_alternative<Command_Reset>(cmd_variant))
+    {
+      m_dsp.reset();
+    }
+  }
+
+  if (memory_changed)
+    publish_memory();
+}
+
+void EmulatorController::sim_thread_func()
+{
+  std::array<s16, FRAMES_PER_BLOCK * 2> block;
+  auto dsp_state_time = std::chrono::steady_clock::now();
+
+  while (!m_quit)
+  {
+    // Samples are rendered whole, so commands always land between two of them
+    if (m_commands.ready())
+      run_user_commands();
+
+    // Stopped, the host hasn't consumed enough audio yet, or ahead of the wall clock
+    if (!can_render(m_step_count))
+    {
+      // Stopped: the GUI should see exactly where
+      if (m_step_count == 0)
+        publish_dsp_state();
+      wait_for_work();
+      continue;
+    }
+
+    // Render a block of frames when running, or up to a block of the requested steps. When paced,
+    // only what is due; if that has piled up (e.g. the host was busy) the debt is dropped rather
+    // than rendered in a burst.
+    uint64_t frames = m_step_count > 0 ? std::min<uint64_t>(m_step_count, FRAMES_PER_BLOCK) : FRAMES_PER_BLOCK;
+    if (m_step_count < 0 && is_paced())
+    {
+      const uint64_t due = paced_frames(std::chrono::steady_clock::now());
+      if (due > MAX_PACE_DEBT_FRAMES)
+      {
+        restart_pacing();
+        continue;
+      }
+      frames = std::min(frames, due);
+    }
+
+    m_dsp.render(m_memory.shared_memory.data(), block.data(), (u32)frames);
+    m_pace_frames += frames;
+    m_telemetry.cycles = m_dsp.sample_count() * DSPModel::cycles_per_sample;
+    if (m_step_count > 0)
+      m_step_count -= frames;
+
+    // Turbo plays whatever fits in the queue, and slow motion is muted
+    AudioQueue *audio_queue = m_audio_queue;
+    if (audio_queue && m_speed_mode != SpeedMode_SlowMotion)
+    {
+      const u32 pushed = std::min((u32)frames, audio_queue->freeFrames());
+      audio_queue->pushFrames(block.data(), pushed);
+      if (pushed < frames && m_speed_mode == SpeedMode_Realtime)
+        m_telemetry.dropped_frames.fetch_add(frames - pushed, std::memory_order_relaxed);
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - dsp_state_time >= DSP_STATE_PERIOD)
+    {
+      publish_dsp_state();
+      dsp_state_time = now;
+    }
+  }
+}
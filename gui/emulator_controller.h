@@ -0,0 +1,152 @@
+#pragma once
+
+#include "controller.h"
+
+#include "DSPModel.h"
+#include "command_ring.h"
+#include "triple_buffer.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <variant>
+#include <vector>
+
+// Controller backed by the native, sample-accurate DSPModel. Rather than clocking VTestDSP 64 times
+// per output sample, whole samples are rendered directly, which is fast enough to audition and batch
+// render material far beyond real time. Results can then be confirmed on the VerilatorController.
+//
+// Threading follows VerilatorController: the GUI only ever queues commands and reads published
+// snapshots, and the model and RAM belong to the simulation thread.
+class EmulatorController : public Controller
+{
+public:
+  EmulatorController();
+  ~EmulatorController();
+
+  void setAudioQueue(AudioQueue *audio_queue) final;
+  AudioQueue *getAudioQueue() final { return m_audio_queue; }
+
+  // Retrieve state from the system
+  bool getCPUState(CPUState *);
+  bool getDSPState(DSPState *);
+  bool getMemoryState(MemoryState *);
+
+  // Set State
+  bool setCPURegister(uint8_t registerIndex, uint8_t value);
+  bool setDSPRegister(uint8_t registerIndex, uint8_t value);
+  bool setMemorySpan(uint16_t addressOffset, uint32_t range, const u8 *data, std::shared_ptr<const void> storage);
+  bool setDSPRegisters(const u8 values[128]) final;
+  bool loadState(const APUState &state) final;
+
+  // Hardware control. A single step renders one whole output sample.
+  void singleStep();
+  void resume();
+  void stop();
+  void setSpeed(SpeedMode mode, float factor = 1.0f);
+  void reset();
+
+  uint64_t getCycleCount() const final { return m_telemetry.cycles; }
+  float getDutyCycle() final { return m_duty_cycle.update(m_telemetry); }
+  SimTelemetry *getTelemetry() final { return &m_telemetry; }
+
+private:
+  // Everything the GUI asks of the simulation goes through m_commands, and is applied by the
+  // simulation thread in one batch between samples. None of them take simulated time.
+  struct Command_SetDSPRegValue
+  {
+    u8 dsp_reg;
+    u8 reg_value;
+  };
+
+  // As Command_LoadState, the data stays where the caller borrowed it from
+  struct Command_WriteRAM
+  {
+    u16 address;
+    u32 size;
+    const u8 *data;
+    std::shared_ptr<const void> storage;
+  };
+
+  struct Command_WriteDSPRegisters
+  {
+    std::array<u8, 128> values;
+  };
+
+  // The images stay where the caller's state borrowed them from until the command is run
+  struct Command_LoadState
+  {
+    APUState state;
+  };
+
+  // Sets the run state: step_count samples, then stop. 0 stops, -1 runs freely.
+  struct Command_Run
+  {
+    int64_t step_count;
+  };
+
+  struct Command_SetSpeed
+  {
+    SpeedMode mode;
+    float factor;
+  };
+
+  struct Command_Reset
+  {
+  };
+
+  using UserCommand = std::variant<Command_SetDSPRegValue, Command_WriteRAM, Command_WriteDSPRegisters,
+                                   Command_LoadState, Command_Run, Command_SetSpeed, Command_Reset>;
+
+  struct QueuedCommand
+  {
+    UserCommand command;
+    int64_t queued_ns; // For the command latency telemetry
+  };
+
+  void sim_thread_func();
+  void run_user_commands();
+  bool can_render(int64_t step_count) const;
+  bool is_paced() const;
+  void restart_pacing();
+  double paced_frames_per_sec() const;
+  uint64_t paced_frames(std::chrono::steady_clock::time_point now) const;
+  uint64_t pace_chunk_frames() const;
+  std::chrono::steady_clock::time_point pace_deadline() const;
+  void wait_for_work();
+  void push_command(UserCommand command);
+  void publish_dsp_state();
+  void publish_memory();
+
+  // Samples left to render, or -1 when running freely. Only the simulation thread touches it.
+  int64_t m_step_count = -1;
+
+  // How fast to run freely, as set by Command_SetSpeed. Only the simulation thread touches these.
+  SpeedMode m_speed_mode = SpeedMode_Realtime;
+  float m_speed_factor = 1.0f;
+
+  // Pacing by the wall clock (see paced_frames()): the frames rendered since m_pace_start
+  std::chrono::steady_clock::time_point m_pace_start = std::chrono::steady_clock::now();
+  uint64_t m_pace_frames = 0;
+  std::atomic<bool> m_quit = false;
+
+  // Wakes the simulation thread when there is something for it to do. See wait_for_work().
+  SimEvent m_wake;
+
+  SimDutyCycle m_duty_cycle;
+
+  std::thread m_thread;
+  DSPModel m_dsp;
+  MemoryState m_memory = {};
+  std::atomic<AudioQueue *> m_audio_queue = nullptr;
+
+  CommandRing<QueuedCommand, 1024> m_commands;
+
+  // What the GUI sees of the simulation. The DSP state is published at most once per display
+  // refresh and whenever the simulation thread goes to sleep, and RAM whenever a command changes it.
+  TripleBuffer<DSPState> m_dsp_state;
+  TripleBuffer<MemoryState> m_memory_state;
+  SimTelemetry m_telemetry;
+};
@@ -14,18 +14,35 @@
 #include <SDL_opengl.h>
 #endif
 
+#include <chrono>
 #include <queue>
 #include <thread>
 
 #include "im_file_picker.h"
 
+#include "audio_output.h"
+#include "emulator_controller.h"
 #include "verilator_controller.h"
 Controller *controller;
 
+enum Backend
+{
+  Backend_Verilator = 0,
+  Backend_Emulator,
+};
+static const char *backend_names[] = {"Verilator (cycle accurate)", "Emulator (sample accurate)"};
+int g_backend = Backend_Verilator;
+static const char *speed_mode_names[] = {"Real time", "Turbo", "Slow motion"};
+int g_speed_mode = SpeedMode_Realtime;
+float g_slow_motion_factor = 0.01f;
+
 CPUState g_cpu_state;
 DSPState g_dsp_state;
 MemoryState g_memory_state;
 AudioQueue *g_audio_queue;
+AudioOutput *g_audio_output;
+static const char *audio_latency_names[] = {"Low (live tweaking)", "Deep (slow simulations)"};
+SDL_AudioDeviceID g_audio_device = 0;
 
 void update_state()
 {
@@ -34,11 +51,119 @@ void update_state()
   controller->getMemoryState(&g_memory_state);
 }
 
+Controller *create_controller(int backend)
+{
+  if (backend == Backend_Emulator)
+    return new EmulatorController();
+  return new VerilatorController();
+}
+
+// Replaces the running controller with a new backend, carrying over RAM and DSP registers. The old
+// controller is destroyed first so only one simulation thread ever feeds the audio queue.
+void switch_backend(int backend)
+{
+  // The new controller borrows the RAM image until its simulation thread has applied it
+  auto memory = std::make_shared<MemoryState>();
+  static DSPState dsp;
+  controller->getMemoryState(memory.get());
+  controller->getDSPState(&dsp);
+
+  // The audio callback wakes the controller's simulation thread, so make sure it isn't running
+  // while the controller goes away.
+  if (g_audio_device)
+    SDL_LockAudioDevice(g_audio_device);
+  delete controller;
+  if (g_audio_device)
+    SDL_UnlockAudioDevice(g_audio_device);
+
+  controller = create_controller(backend);
+  controller->setAudioQueue(g_audio_queue);
+  controller->setSpeed((SpeedMode)g_speed_mode, g_slow_motion_factor);
+
+  controller->setMemorySpan(0, MemoryState::shared_memory_size, memory->shared_memory.data(), memory);
+  controller->setDSPRegisters(dsp.register_values);
+}
+
+// Telemetry from the simulation thread and the audio callback. Rates are worked out from how far
+// the counters moved over the last half second or so.
+void draw_performance()
+{
+  struct Sample
+  {
+    std::chrono::steady_clock::time_point time;
+    u64 cycles = 0;
+    u64 commands = 0;
+    u64 command_latency_ns = 0;
+  };
+  static Sample last = {std::chrono::steady_clock::now()};
+  static double cycles_per_sec = 0;
+  static double command_latency_ms = 0;
+  static double command_latency_max_ms = 0;
+
+  SimTelemetry *sim = controller->getTelemetry();
+  const AudioTelemetry &audio = g_audio_output->getTelemetry();
+
+  Sample now = {std::chrono::steady_clock::now(), controller->getCycleCount()};
+  if (sim)
+  {
+    now.commands = sim->commands;
+    now.command_latency_ns = sim->command_latency_ns;
+  }
+  const std::chrono::duration<double> window = now.time - last.time;
+  if (window.count() >= 0.5)
+  {
+    // Counters start over when the backend is switched
+    cycles_per_sec = now.cycles >= last.cycles ? (now.cycles - last.cycles) / window.count() : 0;
+    const u64 commands = now.commands >= last.commands ? now.commands - last.commands : 0;
+    command_latency_ms = commands ? (now.command_latency_ns - last.command_latency_ns) / 1e6 / commands : 0;
+    command_latency_max_ms = sim ? sim->command_latency_max_ns.exchange(0) / 1e6 : 0;
+    last = now;
+  }
+
+  ImGui::Begin("Performance");
+  ImGui::Text("Simulation: %.0f cycles/sec (%.3fx realtime)", cycles_per_sec,
+              cycles_per_sec / SimTelemetry::RealtimeCyclesPerSecond);
+  ImGui::Text("Simulation thread idle: %.0f%%", (1.0f - controller->getDutyCycle()) * 100.0f);
+  if (sim)
+  {
+    ImGui::Text("Command latency: %.3f ms average, %.3f ms max", command_latency_ms, command_latency_max_ms);
+    ImGui::Text("Overruns: %llu frames dropped", (unsigned long long)sim->dropped_frames);
+  }
+  else
+  {
+    ImGui::Text("No simulation thread telemetry from this backend");
+  }
+
+  ImGui::Separator();
+  const u32 fill_frames = audio.fill_frames;
+  const u32 target_frames = audio.target_frames;
+  ImGui::Text("Audio queue: %u frames (%.0f ms), target %u frames (%.0f ms)", fill_frames,
+              fill_frames * 1000.0f / AudioOutput::SampleRate, target_frames,
+              target_frames * 1000.0f / AudioOutput::SampleRate);
+  ImGui::Text("Playback rate: %.4f", (float)audio.rate);
+  ImGui::Text("Underruns: %llu", (unsigned long long)audio.underruns);
+  ImGui::Text("Audio callbacks: %llu, %llu frames", (unsigned long long)audio.callbacks,
+              (unsigned long long)audio.frames_played);
+  ImGui::End();
+}
+
 void draw_gui()
 {
   {
     ImGui::Begin("Global State");
     ImGui::Text("Simulator Cycles: %lu", controller->getCycleCount());
+    ImGui::Text("Simulator Duty Cycle: %.0f%%", controller->getDutyCycle() * 100.0f);
+
+    int latency_mode = g_audio_output->getLatencyMode();
+    if (ImGui::Combo("Audio Latency", &latency_mode, audio_latency_names, IM_ARRAYSIZE(audio_latency_names)))
+      g_audio_output->setLatencyMode((AudioLatencyMode)latency_mode);
+
+    int backend = g_backend;
+    if (ImGui::Combo("Backend", &backend, backend_names, IM_ARRAYSIZE(backend_names)) && backend != g_backend)
+    {
+      g_backend = backend;
+      switch_backend(backend);
+    }
 
     if (ImGui::Button("Step"))
       controller->singleStep();
@@ -52,6 +177,23 @@ void draw_gui()
     if (ImGui::Button("Reset"))
       controller->reset();
 
+    // Turbo skips through long intros; slow motion lets the DSP Internals window follow the voices
+    bool speed_changed = ImGui::Combo("Speed", &g_speed_mode, speed_mode_names, IM_ARRAYSIZE(speed_mode_names));
+    if (g_speed_mode == SpeedMode_SlowMotion)
+      speed_changed |= ImGui::SliderFloat("Fraction of Real Time", &g_slow_motion_factor, 0.00001f, 1.0f, "%.5f",
+                                          ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp);
+    if (speed_changed)
+      controller->setSpeed((SpeedMode)g_speed_mode, g_slow_motion_factor);
+
+    static char snapshot_path[256] = "snapshot.vlt";
+    if (ImGui::Button("Snapshot"))
+      controller->saveSnapshot(snapshot_path);
+    ImGui::SameLine();
+    if (ImGui::Button("Restore"))
+      controller->restoreSnapshot(snapshot_path);
+    ImGui::SameLine();
+    ImGui::InputText("##snapshot_path", snapshot_path, sizeof(snapshot_path));
+
     static ImFilePicker ram_file_picker(".");
     ram_file_picker.on_file_open = [&](const char *file_path)
     {
@@ -125,22 +267,15 @@ void draw_gui()
       ImGui::SetTooltip("%s", getDSPRegisterDescription(i));
   }
   ImGui::End();
+
+  draw_performance();
 }
 
 // https://wiki.libsdl.org/SDL_AudioSpec#callback
 void sdl_audio_callback(void *userdata, uint8_t *out_data, int length)
 {
-  const u32 available = g_audio_queue->availableFrames();
-  if (!g_audio_queue || available < 4096)
-  {
-    printf("Audio underrun\n");
-    fflush(stdout);
-    memset(out_data, 0, length);
-    return;
-  }
-
-  g_audio_queue->consumeFrames((int16_t *)out_data, 4096);
-  fflush(stdout);
+  // Runs on SDL's audio thread: no printing or anything else that might block in here
+  g_audio_output->render((int16_t *)out_data, length / (2 * sizeof(int16_t)));
 }
 
 // Main code
@@ -206,15 +341,17 @@ int main(int, char **)
   ImGui_ImplSDL2_InitForOpenGL(window, gl_context);
   ImGui_ImplOpenGL3_Init(glsl_version);
 
-  // Audio Init
-  SDL_AudioDeviceID sdl_audio_dev;
+  // Audio Init. The output exists before the device, so the callback always has it.
+  g_audio_queue = new AudioQueue();
+  g_audio_output = new AudioOutput(g_audio_queue);
+  SDL_AudioDeviceID &sdl_audio_dev = g_audio_device;
   {
     SDL_AudioSpec desired = {};
     desired.channels = 2;
     desired.format = AUDIO_S16;
     desired.callback = sdl_audio_callback;
     desired.freq = 32000;
-    desired.samples = 4096; // Buffer size in samples, must be PoT
+    desired.samples = 512; // Buffer size in samples, must be PoT. AudioOutput buffers on top of this.
 
     SDL_AudioSpec obtained;
     if (0 == (sdl_audio_dev = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, 0)))
@@ -234,9 +371,7 @@ int main(int, char **)
   bool show_another_window = false;
   ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
-  g_audio_queue = new AudioQueue();
-
-  controller = new VerilatorController();
+  controller = create_controller(g_backend);
   controller->setAudioQueue(g_audio_queue);
 
   // Main loop
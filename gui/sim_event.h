@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <semaphore>
+
+// Lets a simulation thread sleep until something it is waiting on changes: room in the audio
+// queue, a control from the GUI, a new command. The condition itself lives elsewhere (usually in
+// atomics); whoever changes it calls notify() afterwards.
+//
+// notify() never locks, so it is safe on the audio callback. It only touches the semaphore when the
+// waiter has flagged that it is going to sleep, which is rare while the simulation keeps up, and
+// otherwise costs one load. There is a single waiter, the simulation thread, and 'ready' must only
+// read atomics or state the waiter owns.
+class SimEvent
+{
+public:
+  void notify()
+  {
+    // Orders the caller's change before the load, pairing with the fence in sleep(): either the
+    // waiter sees the change, or this sees the waiter's flag and wakes it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed) && m_sleeping.exchange(false, std::memory_order_acq_rel))
+      m_sem.release();
+  }
+
+  // Blocks until 'ready()' returns true, checking it first and after every notify.
+  template <class Ready>
+  void wait(Ready ready)
+  {
+    while (!ready())
+      sleep(ready, [this]() { m_sem.acquire(); return true; });
+  }
+
+  // As wait(), but gives up at 'deadline'. Returns ready().
+  template <class Clock, class Duration, class Ready>
+  bool wait_until(const std::chrono::time_point<Clock, Duration> &deadline, Ready ready)
+  {
+    while (!ready())
+    {
+      if (!sleep(ready, [&]() { return m_sem.try_acquire_until(deadline); }))
+        return ready();
+    }
+    return true;
+  }
+
+private:
+  // Flags the waiter as sleeping, then blocks in 'block' unless 'ready()' became true in the
+  // meantime. Returns false if 'block' gave up without being woken.
+  template <class Ready, class Block>
+  bool sleep(Ready ready, Block block)
+  {
+    m_sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready())
+    {
+      if (block())
+        return true;
+    }
+    cancel_sleep();
+    return false;
+  }
+
+  // Takes the flag back. If a notify() got to it first, its release is on the way and is consumed
+  // here, so the semaphore is empty again for the next sleep.
+  void cancel_sleep()
+  {
+    if (!m_sleeping.exchange(false, std::memory_order_acq_rel))
+      m_sem.acquire();
+  }
+
+  std::atomic<bool> m_sleeping = false;
+  std::binary_semaphore m_sem{0};
+};
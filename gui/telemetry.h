@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "types.h"
+
+// Counters that the simulation thread and the audio callback bump as they go, for the GUI's
+// Performance window. Every field is a lock-free atomic that makes sense on its own, and is updated
+// once per block of work rather than per cycle or frame, so keeping them costs next to nothing and
+// never waits on the reader. Most only ever grow; the reader turns them into rates by differencing
+// two samples.
+
+inline int64_t telemetry_now_ns()
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Raises 'max' to 'value' if it is larger. Safe with several writers and a reader that resets it.
+inline void telemetry_max(std::atomic<u64> &max, u64 value)
+{
+  u64 current = max.load(std::memory_order_relaxed);
+  while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    ;
+}
+
+// Written by a controller's simulation thread
+struct SimTelemetry
+{
+  // DSP clock rate of the real hardware, for the realtime factor
+  static constexpr double RealtimeCyclesPerSecond = 32000.0 * 64;
+
+  std::atomic<u64> cycles = 0;
+
+  // Nanoseconds spent in finished sleeps, and when the current one started (0 if awake)
+  std::atomic<u64> idle_ns = 0;
+  std::atomic<int64_t> sleep_start_ns = 0;
+
+  // Frames made while the audio queue had no room for them, and thrown away
+  std::atomic<u64> dropped_frames = 0;
+
+  // Commands from the GUI, and how long they waited between being queued and being applied. The
+  // reader resets the max.
+  std::atomic<u64> commands = 0;
+  std::atomic<u64> command_latency_ns = 0;
+  std::atomic<u64> command_latency_max_ns = 0;
+};
+
+// Fraction of wall time a simulation thread spends simulating rather than sleeping, worked out from
+// its idle time over windows of half a second or so. For the GUI thread.
+class SimDutyCycle
+{
+public:
+  float update(const SimTelemetry &telemetry)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    const std::chrono::duration<double, std::nano> window = now - m_window_start;
+    if (window.count() >= 0.5e9)
+    {
+      u64 idle_ns = telemetry.idle_ns;
+      const int64_t sleep_start_ns = telemetry.sleep_start_ns;
+      if (sleep_start_ns)
+        idle_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count() - sleep_start_ns;
+      m_duty_cycle = (float)std::clamp(1.0 - (idle_ns - m_window_idle_ns) / window.count(), 0.0, 1.0);
+      m_window_start = now;
+      m_window_idle_ns = idle_ns;
+    }
+    return m_duty_cycle;
+  }
+
+private:
+  std::chrono::steady_clock::time_point m_window_start = std::chrono::steady_clock::now();
+  u64 m_window_idle_ns = 0;
+  float m_duty_cycle = 1.0f;
+};
+
+// Written by the audio callback
+struct AudioTelemetry
+{
+  std::atomic<u64> callbacks = 0;
+  std::atomic<u64> frames_played = 0; // Silence included
+
+  std::atomic<u64> underruns = 0;
+
+  // Frames queued when the last callback started, and the buffer depth being aimed for
+  std::atomic<u32> fill_frames = 0;
+  std::atomic<u32> target_frames = 0;
+
+  // Playback rate from the drift correction, 1.0 when not correcting
+  std::atomic<float> rate = 1.0f;
+};
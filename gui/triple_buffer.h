@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+#include "types.h"
+
+// Hands the latest copy of a value from one writer thread to one reader thread, e.g. the simulation
+// state shown by the GUI. There are three copies: the writer fills its back buffer and publishes it
+// by swapping it with the middle one, and the reader swaps the middle one for its front buffer when
+// something new was published. Neither side ever waits for the other, and the reader only ever sees
+// whole values, never one the writer is halfway through.
+template <class T>
+class TripleBuffer
+{
+public:
+  // Writer only. The copy to fill in before publish().
+  T &back() { return m_buffers[m_back]; }
+
+  // Writer only. Makes the back buffer the latest value, and hands the writer another one to fill.
+  void publish()
+  {
+    m_back = m_middle.exchange(m_back | FreshBit, std::memory_order_acq_rel) & IndexMask;
+  }
+
+  // Reader only. The latest published value. It stays untouched until the next call.
+  const T &read()
+  {
+    if (m_middle.load(std::memory_order_relaxed) & FreshBit)
+      m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+    return m_buffers[m_front];
+  }
+
+private:
+  static constexpr size_t CacheLineSize = 64;
+  static constexpr u8 IndexMask = 0b11;
+  static constexpr u8 FreshBit = 0b100;
+
+  std::array<T, 3> m_buffers = {};
+  alignas(CacheLineSize) u8 m_back = 0;
+  alignas(CacheLineSize) std::atomic<u8> m_middle = 1;
+  alignas(CacheLineSize) u8 m_front = 2;
+};
@@ -1,8 +1,12 @@
 #include "verilator_controller.h"
 
+#include "Backdoor.h"
 #include "VTestDSP_DSP.h"
 #include "VTestDSP_TestDSP.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <thread>
 #include <vector>
 
@@ -10,10 +14,24 @@ const unsigned DSP_FRAME_RATE = 32000;
 const unsigned DSP_CYCLES_PER_FRAME = 64;
 const unsigned DSP_CYCLES_PER_SEC = DSP_FRAME_RATE * DSP_CYCLES_PER_FRAME;
 
+// Frames simulated per call into the bench while running freely
+const unsigned FRAMES_PER_BLOCK = 256;
+
+// Cycles a wall-clock paced simulation may fall behind by before it gives up catching up
+const uint64_t MAX_PACE_DEBT_CYCLES = DSP_CYCLES_PER_SEC / 10;
+
+// How often the GUI is given a fresh DSP state while running. No point outpacing the display.
+const auto DSP_STATE_PERIOD = std::chrono::microseconds(1000000 / 60);
+
 VerilatorController::VerilatorController()
 {
   m_dsp_bench = std::make_shared<BasicBench<VTestDSP>>();
-  reset();
+  m_dsp_bench->add_checkpoint_region(m_ram.raw(), RAM::size());
+  m_dsp_bench->attach_ram(m_ram.raw());
+  m_dsp_bench->reset();
+  loadDefaultDSPRegisters();
+  publish_dsp_state();
+  publish_memory();
 
   // Kick off the simulation thread
   m_thread = std::thread([&]()
@@ -22,169 +40,439 @@ VerilatorController::VerilatorController()
 
 VerilatorController::~VerilatorController()
 {
+  if (AudioQueue *audio_queue = m_audio_queue)
+    audio_queue->setConsumeEvent(nullptr);
+
   m_quit = true;
+  m_wake.notify();
   m_thread.join();
 }
 
+void VerilatorController::setAudioQueue(AudioQueue *audio_queue)
+{
+  if (AudioQueue *old_audio_queue = m_audio_queue.exchange(audio_queue))
+    old_audio_queue->setConsumeEvent(nullptr);
+  if (audio_queue)
+    audio_queue->setConsumeEvent(&m_wake);
+  m_wake.notify();
+}
+
 bool VerilatorController::getCPUState(CPUState *) { return true; }
 bool VerilatorController::getDSPState(DSPState *out)
 {
   if (!out)
     return false;
 
-  // Some of how this is accessed will have to change once we have a more proper top module
-  const auto &top = *m_dsp_bench->get();
-  out->major_cycle = top.major_step;
-  out->ram_address = top.ram_address;
-  out->ram_data = top.ram_data;
-
-  for(u8 i=0; i<128; ++i) {
-    out->register_values[i] = top.___05Fdebug_out_regs[i];
-  }
+  *out = m_dsp_state.read();
+  return true;
+}
 
-  for (u8 i = 0; i < DSPState::num_voices; ++i)
-  {
-    const unsigned voice_state = (top.voice_states_out >> (i * 4)) & 0b1111;
-    out->voice[i].fsm_state = voice_state;
-    out->voice[i].decoder_address = top.___05Fdebug_voice_ram_address[i];
-    out->voice[i].decoder_cursor = top.___05Fdebug_voice_cursors[i];
-    out->voice[i].decoder_output = top.___05Fdebug_voice_output[i];
-  }
+bool VerilatorController::getMemoryState(MemoryState *out)
+{
+  if (!out)
+    return false;
 
+  *out = m_memory_state.read();
   return true;
 }
-bool VerilatorController::getMemoryState(MemoryState *) { return true; }
 
 // Set State
-bool VerilatorController::setCPURegister(uint8_t registerIndex, uint8_t value) { return true; }
+bool VerilatorController::setCPURegister(uint8_t registerIndex, uint8_t value)
+{
+  push_command(Command_SetCPURegValue{registerIndex, value});
+  return true;
+}
 
 bool VerilatorController::setDSPRegister(uint8_t registerIndex, uint8_t value)
 {
-  std::lock_guard lock(m_user_command_mutex);
-  UserCommand new_command = Command_SetDSPRegValue{registerIndex, value};
-  m_user_commands.push_back(new_command);
+  push_command(Command_SetDSPRegValue{registerIndex, value});
   return true;
 }
 
-bool VerilatorController::setMemorySpan(uint16_t addressOffset, uint32_t range, uint8_t *data)
+bool VerilatorController::setMemorySpan(uint16_t addressOffset, uint32_t range, const u8 *data,
+                                        std::shared_ptr<const void> storage)
 {
   assert(addressOffset < 64 * 1024);
   assert(addressOffset + range <= 64 * 1024);
-  m_ram.put(addressOffset, range, data);
+  push_command(Command_WriteRAM{addressOffset, range, data, std::move(storage)});
+  return true;
+}
+
+bool VerilatorController::setDSPRegisters(const u8 values[128])
+{
+  Command_WriteDSPRegisters command;
+  std::copy(values, values + 128, command.values.begin());
+  push_command(std::move(command));
+  return true;
+}
+
+bool VerilatorController::loadState(const APUState &state)
+{
+  push_command(Command_LoadState{state});
   return true;
 }
 
 // Hardware control
-void VerilatorController::singleStep() { m_step_count = 1; }
-void VerilatorController::resume() { m_step_count = -1; }
-void VerilatorController::stop() { m_step_count = 0; }
-void VerilatorController::setSpeed() { ; }
+void VerilatorController::singleStep() { push_command(Command_Run{1}); }
+void VerilatorController::resume() { push_command(Command_Run{-1}); }
+void VerilatorController::stop() { push_command(Command_Run{0}); }
+void VerilatorController::runUntil(uint64_t cycle) { push_command(Command_RunUntil{cycle}); }
+void VerilatorController::setSpeed(SpeedMode mode, float factor) { push_command(Command_SetSpeed{mode, factor}); }
 void VerilatorController::reset()
 {
-  m_dsp_bench->reset();
+  push_command(Command_Reset{});
 
-  // Initialize state
-  const u8 max_volume = 0x7F;
-  const u8 voice_volume = max_volume / 8;
-
-  setDSPRegister(DSPRegister_VOLL0, voice_volume);
-  setDSPRegister(DSPRegister_VOLL1, voice_volume);
-  setDSPRegister(DSPRegister_VOLL2, voice_volume);
-  setDSPRegister(DSPRegister_VOLL3, voice_volume);
-  setDSPRegister(DSPRegister_VOLL4, voice_volume);
-  setDSPRegister(DSPRegister_VOLL5, voice_volume);
-  setDSPRegister(DSPRegister_VOLL6, voice_volume);
-  setDSPRegister(DSPRegister_VOLL7, voice_volume);
-
-  setDSPRegister(DSPRegister_VOLR0, voice_volume);
-  setDSPRegister(DSPRegister_VOLR1, voice_volume);
-  setDSPRegister(DSPRegister_VOLR2, voice_volume);
-  setDSPRegister(DSPRegister_VOLR3, voice_volume);
-  setDSPRegister(DSPRegister_VOLR4, voice_volume);
-  setDSPRegister(DSPRegister_VOLR5, voice_volume);
-  setDSPRegister(DSPRegister_VOLR6, voice_volume);
-  setDSPRegister(DSPRegister_VOLR7, voice_volume);
-
-  const u16 vpitch = 4096 / 4; // nominal
-  const u8 PL = vpitch & 0xFF;
-  const u8 PH = (vpitch >> 8) & 0x3F;
-
-  setDSPRegister(DSPRegister_PL0, PL);
-  setDSPRegister(DSPRegister_PL1, PL);
-  setDSPRegister(DSPRegister_PL2, PL);
-  setDSPRegister(DSPRegister_PL3, PL);
-  setDSPRegister(DSPRegister_PL4, PL);
-  setDSPRegister(DSPRegister_PL5, PL);
-  setDSPRegister(DSPRegister_PL6, PL);
-  setDSPRegister(DSPRegister_PL7, PL);
-
-  setDSPRegister(DSPRegister_PH0, PH);
-  setDSPRegister(DSPRegister_PH1, PH);
-  setDSPRegister(DSPRegister_PH2, PH);
-  setDSPRegister(DSPRegister_PH3, PH);
-  setDSPRegister(DSPRegister_PH4, PH);
-  setDSPRegister(DSPRegister_PH5, PH);
-  setDSPRegister(DSPRegister_PH6, PH);
-  setDSPRegister(DSPRegister_PH7, PH);
-
-  setDSPRegister(DSPRegister_MVOLL, max_volume);
-  setDSPRegister(DSPRegister_MVOLR, max_volume);
-
-  // Experimenting with pitch modulation
-  // setDSPRegister(DSPRegister_PMON, 0b01000000);
+  loadDefaultDSPRegisters();
 }
 
-void VerilatorController::sim_thread_func()
+// Snapshots are taken on the simulation thread, between clocks, like any other command.
+bool VerilatorController::saveSnapshot(const char *path)
+{
+  push_command(Command_SaveSnapshot{path});
+  return true;
+}
+
+bool VerilatorController::restoreSnapshot(const char *path)
+{
+  push_command(Command_RestoreSnapshot{path});
+  return true;
+}
+
+float VerilatorController::getDutyCycle() { return m_duty_cycle.update(m_telemetry); }
+
+// Never blocks the simulation thread. If the ring is full, the caller waits for it to drain.
+void VerilatorController::push_command(UserCommand command)
+{
+  QueuedCommand queued = {std::move(command), telemetry_now_ns()};
+  while (!m_commands.push(std::move(queued)))
+  {
+    m_wake.notify();
+    std::this_thread::yield();
+  }
+  m_wake.notify();
+}
+
+// Copies what the GUI displays out of the model. Simulation thread only.
+void VerilatorController::publish_dsp_state()
+{
+  DSPState &state = m_dsp_state.back();
+
+  // Some of how this is accessed will have to change once we have a more proper top module
+  const auto &top = *m_dsp_bench->get();
+  state.major_cycle = top.major_step;
+  state.ram_address = top.ram_address;
+  state.ram_data = top.ram_data;
+
+  for(u8 i=0; i<128; ++i) {
+    state.register_values[i] = top.___05Fdebug_out_regs[i];
+  }
+
+  for (u8 i = 0; i < DSPState::num_voices; ++i)
+  {
+    const unsigned voice_state = (top.voice_states_out >> (i * 4)) & 0b1111;
+    state.voice[i].fsm_state = voice_state;
+    state.voice[i].decoder_address = top.___05Fdebug_voice_ram_address[i];
+    state.voice[i].decoder_cursor = top.___05Fdebug_voice_cursors[i];
+    state.voice[i].decoder_output = top.___05Fdebug_voice_output[i];
+  }
+
+  m_dsp_state.publish();
+  m_telemetry.cycles = m_dsp_bench->get_tick_count();
+}
+
+// TestDSP only reads RAM, so it only changes through commands. Simulation thread only.
+void VerilatorController::publish_memory()
+{
+  m_ram.get(0, MemoryState::shared_memory_size, m_memory_state.back().shared_memory.data());
+  m_memory_state.publish();
+}
+
+// Whether the simulation thread has clocks to run: single steps, or free running in turbo, with room
+// in the audio queue for another block, or with cycles due by the wall clock.
+bool VerilatorController::can_clock(int64_t step_count) const
+{
+  if (step_count > 0)
+    return true;
+  if (step_count == 0)
+    return false;
+  if (m_speed_mode == SpeedMode_Turbo)
+    return true;
+  const AudioQueue *audio_queue = m_audio_queue;
+  if (m_speed_mode == SpeedMode_Realtime && audio_queue)
+    return audio_queue->freeFrames() >= FRAMES_PER_BLOCK;
+  return paced_cycles(std::chrono::steady_clock::now()) >= pace_chunk_cycles();
+}
+
+// Whether queued commands may run now. While running freely they wait for the start of a sample, so
+// that the sample being output is finished first and all of them land before the next one starts.
+// Slow motion may not reach a sample boundary for a long while, so there they run right away.
+bool VerilatorController::commands_due() const
+{
+  if (!m_commands.ready())
+    return false;
+  if (m_step_count >= 0 || m_speed_mode == SpeedMode_SlowMotion)
+    return true;
+  return m_dsp_bench->cycles_until_sample() == DSP_CYCLES_PER_FRAME - 1;
+}
+
+// Real time is kept by the audio device when there is one. Without one, and in slow motion, the
+// simulation is paced by the wall clock instead.
+bool VerilatorController::is_paced() const
+{
+  return m_speed_mode == SpeedMode_SlowMotion || (m_speed_mode == SpeedMode_Realtime && !m_audio_queue);
+}
+
+void VerilatorController::restart_pacing()
+{
+  m_pace_start = std::chrono::steady_clock::now();
+  m_pace_cycles = 0;
+}
+
+double VerilatorController::paced_cycles_per_sec() const
+{
+  const double factor = m_speed_mode == SpeedMode_SlowMotion ? m_speed_factor : 1.0;
+  return factor * DSP_CYCLES_PER_SEC;
+}
+
+// Cycles that may be run at 'now' without getting ahead of the wall clock
+uint64_t VerilatorController::paced_cycles(std::chrono::steady_clock::time_point now) const
+{
+  const std::chrono::duration<double> elapsed = now - m_pace_start;
+  const uint64_t allowed = (uint64_t)(elapsed.count() * paced_cycles_per_sec());
+  return allowed > m_pace_cycles ? allowed - m_pace_cycles : 0;
+}
+
+// Paced cycles are run a millisecond's worth at a time, or one at a time at very slow speeds, so
+// that the simulation thread wakes up at most about a thousand times a second.
+uint64_t VerilatorController::pace_chunk_cycles() const
+{
+  return std::max<uint64_t>(1, (uint64_t)(paced_cycles_per_sec() / 1000));
+}
+
+// When the next chunk of cycles falls due
+std::chrono::steady_clock::time_point VerilatorController::pace_deadline() const
+{
+  const std::chrono::duration<double> offset((m_pace_cycles + pace_chunk_cycles()) / paced_cycles_per_sec());
+  return m_pace_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset);
+}
+
+// Sleeps until there are clocks to run, commands due, or we are quitting. Everything that can
+// change one of those notifies m_wake: the controls, push_command() and the audio callback after it
+// consumes from the queue. When paced by the wall clock, the sleep ends at the next deadline.
+void VerilatorController::wait_for_work()
+{
+  const int64_t start_ns = telemetry_now_ns();
+  m_telemetry.sleep_start_ns = start_ns;
+  const auto ready = [&]()
+  { return m_quit || commands_due() || can_clock(m_step_count); };
+  if (m_step_count < 0 && is_paced())
+    m_wake.wait_until(pace_deadline(), ready);
+  else
+    m_wake.wait(ready);
+  m_telemetry.idle_ns += telemetry_now_ns() - start_ns;
+  m_telemetry.sleep_start_ns = 0;
+}
+
+// Runs every command queued so far, as one batch. Registers and states are written with the backdoor,
+// so no command takes simulated time.
+void VerilatorController::run_user_commands()
 {
   auto &top = *m_dsp_bench->get();
-  while (!m_quit)
+  bool memory_changed = false;
+  QueuedCommand queued;
+  while (m_commands.pop(queued))
   {
-    // Run any commands requested. Note that setting registers etc involves clocking the design!
-    if (!m_user_commands.empty())
+    const uint64_t latency_ns = telemetry_now_ns() - queued.queued_ns;
+    m_telemetry.commands.fetch_add(1, std::memory_order_relaxed);
+    m_telemetry.command_latency_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+    telemetry_max(m_telemetry.command_latency_max_ns, latency_ns);
+
+    const UserCommand &cmd_variant = queued.command;
+    if (std::holds_alternative<Command_SetDSPRegValue>(cmd_variant))
     {
-      std::lock_guard lock(m_user_command_mutex);
-      for (const auto &cmd_variant : m_user_commands)
-      {
-        if (std::holds_alternative<Command_SetDSPRegValue>(cmd_variant))
-        {
-          const Command_SetDSPRegValue &cmd = std::get<Command_SetDSPRegValue>(cmd_variant);
-          top.dsp_reg_address = cmd.dsp_reg;
-          top.dsp_reg_data_in = cmd.reg_value;
-          top.dsp_reg_write_enable = 1;
-          m_dsp_bench->tick();
-          top.dsp_reg_write_enable = 0;
-        }
-      }
-      m_user_commands.clear();
+      const Command_SetDSPRegValue &cmd = std::get<Command_SetDSPRegValue>(cmd_variant);
+      backdoor_write_dsp_register(*top.TestDSP->dsp, cmd.dsp_reg, cmd.reg_value);
+      top.eval();
+    }
+    else if (std::holds_alternative<Command_SetCPURegValue>(cmd_variant))
+    {
+      // TestDSP has no CPU yet
+    }
+    else if (std::holds_alternative<Command_WriteRAM>(cmd_variant))
+    {
+      const Command_WriteRAM &cmd = std::get<Command_WriteRAM>(cmd_variant);
+      m_ram.put(cmd.address, cmd.size, cmd.data);
+      memory_changed = true;
+    }
+    else if (std::holds_alternative<Command_WriteDSPRegisters>(cmd_variant))
+    {
+      const Command_WriteDSPRegisters &cmd = std::get<Command_WriteDSPRegisters>(cmd_variant);
+      backdoor_write_dsp_registers(*top.TestDSP->dsp, cmd.values.data());
+      top.eval();
+    }
+    else if (std::holds_alternative<Command_LoadState>(cmd_variant))
+    {
+      // TestDSP has no CPU yet, so the CPU registers have nowhere to go
+      const APUState &state = std::get<Command_LoadState>(cmd_variant).state;
+      m_ram.put(0, RAM::size(), state.ram);
+      backdoor_write_dsp_registers(*top.TestDSP->dsp, state.dsp_registers);
+      top.eval();
+      memory_changed = true;
+    }
+    else if (std::holds_alternative<Command_Run>(cmd_variant))
+    {
+      m_step_count = std::get<Command_Run>(cmd_variant).step_count;
+      restart_pacing();
     }
+    else if (std::holds_alternative<Command_RunUntil>(cmd_variant))
+    {
+      const uint64_t cycle = std::get<Command_RunUntil>(cmd_variant).cycle;
+      const uint64_t now = m_dsp_bench->get_tick_count();
+      m_step_count = cycle > now ? cycle - now : 0;
+    }
+    else if (std::holds_alternative<Command_SetSpeed>(cmd_variant))
+    {
+      const Command_SetSpeed &cmd = std::get<Command_SetSpeed>(cmd_variant);
+      m_speed_mode = cmd.mode;
+      m_speed_factor = std::clamp(cmd.factor, 1e-6f, 1.0f);
+      m_audio_stride = cmd.mode == SpeedMode_SlowMotion ? 0 : 1;
+      restart_pacing();
+    }
+    else if (std::holds_alternative<Command_Reset>(cmd_variant))
+    {
+      m_dsp_bench->reset();
+    }
+    else if (std::holds_alternative<Command_SaveSnapshot>(cmd_variant))
+    {
+      const Command_SaveSnapshot &cmd = std::get<Command_SaveSnapshot>(cmd_variant);
+      if (m_dsp_bench->save(cmd.path.c_str()))
+        printf("Saved snapshot to %s\n", cmd.path.c_str());
+      else
+        printf("Failed to save snapshot to %s\n", cmd.path.c_str());
+    }
+    else if (std::holds_alternative<Command_RestoreSnapshot>(cmd_variant))
+    {
+      const Command_RestoreSnapshot &cmd = std::get<Command_RestoreSnapshot>(cmd_variant);
+      if (m_dsp_bench->restore(cmd.path.c_str()))
+        printf("Restored snapshot from %s\n", cmd.path.c_str());
+      else
+        printf("Failed to restore snapshot from %s\n", cmd.path.c_str());
+      memory_changed = true;
+    }
+  }
+
+  if (memory_changed)
+    publish_memory();
+}
+
+void VerilatorController::sim_thread_func()
+{
+  // Audio from each call into the bench is gathered here and pushed to the queue in one go
+  std::array<s16, FRAMES_PER_BLOCK * 2> block;
+  u32 block_frames = 0;
+
+  // Once a DSP_STATE_PERIOD has passed, the DSP state is published at the next sample boundary. The
+  // clock is only read once per call into the bench.
+  bool dsp_state_due = false;
+  auto dsp_state_time = std::chrono::steady_clock::now();
+
+  // Frames skipped since the last one kept, when decimating (see m_audio_stride)
+  uint32_t audio_skipped = 0;
 
-    // If we're buffering audio to the host, but the host hasn't consumed enough, we'll wait.
-    if (m_audio_queue)
+  const auto push_audio = [&](s16 left, s16 right)
+  {
+    if (dsp_state_due)
     {
-      while (m_audio_queue->isFull())
-        std::this_thread::yield();
+      publish_dsp_state();
+      dsp_state_due = false;
     }
+    if (!m_audio_stride || ++audio_skipped < m_audio_stride)
+      return;
+    audio_skipped = 0;
+    if (block_frames == FRAMES_PER_BLOCK)
+      return;
+    block[2 * block_frames] = left;
+    block[2 * block_frames + 1] = right;
+    ++block_frames;
+  };
+  const auto run = [&](uint64_t cycles)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    if (now - dsp_state_time >= DSP_STATE_PERIOD)
+    {
+      dsp_state_due = true;
+      dsp_state_time = now;
+    }
+    m_dsp_bench->run(cycles, push_audio);
+    m_telemetry.cycles = m_dsp_bench->get_tick_count();
+    m_pace_cycles += cycles;
 
-    // Clock the system
-    if (m_step_count != 0)
+    // Slow motion may not reach a sample boundary for a long while, and the point of it is to watch
+    // the DSP change, so don't wait for one.
+    if (dsp_state_due && m_speed_mode == SpeedMode_SlowMotion)
     {
-      // Clock the top module
-      m_dsp_bench->tick();
+      publish_dsp_state();
+      dsp_state_due = false;
+    }
 
-      // Service shared RAM requests
-      top.ram_data = m_ram.get(top.ram_address);
+    // In turbo, keep one frame in however many times faster than real time we are going, so the
+    // audio plays at about its normal pitch rather than mostly being thrown away. Frames that don't
+    // fit are only worth counting as overruns in real time.
+    if (m_speed_mode == SpeedMode_Turbo && cycles == FRAMES_PER_BLOCK * DSP_CYCLES_PER_FRAME)
+    {
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - now;
+      const double speed = cycles / (elapsed.count() * DSP_CYCLES_PER_SEC);
+      m_audio_stride = (uint32_t)std::clamp(speed + 0.5, 1.0, 1e6);
+    }
+    if (AudioQueue *audio_queue = m_audio_queue)
+    {
+      const u32 pushed = std::min(block_frames, audio_queue->freeFrames());
+      audio_queue->pushFrames(block.data(), pushed);
+      if (pushed < block_frames && m_speed_mode == SpeedMode_Realtime)
+        m_telemetry.dropped_frames.fetch_add(block_frames - pushed, std::memory_order_relaxed);
+    }
+    block_frames = 0;
+  };
 
-      if (m_step_count > 0)
-        m_step_count--;
+  while (!m_quit)
+  {
+    if (commands_due())
+      run_user_commands();
 
-      // Audio output
-      const bool sample_ready = top.major_step == DSP_CYCLES_PER_FRAME - 1;
-      if (!m_audio_queue->isFull() && sample_ready)
-        m_audio_queue->push(top.dac_out_l, top.dac_out_r);
+    // Stopped, the host hasn't consumed enough audio yet, or ahead of the wall clock
+    if (!can_clock(m_step_count))
+    {
+      // Stopped: the GUI should see exactly where
+      if (m_step_count == 0)
+      {
+        publish_dsp_state();
+        dsp_state_due = false;
+      }
+      wait_for_work();
+      continue;
     }
-    else
+
+    // Clock the system: a block of frames at a time when running, or up to a block of the
+    // requested steps. When paced, only what is due; if that has piled up (e.g. the host was busy)
+    // the debt is dropped rather than run in a burst.
+    const uint64_t block_cycles = FRAMES_PER_BLOCK * DSP_CYCLES_PER_FRAME;
+    uint64_t cycles = m_step_count > 0 ? std::min<uint64_t>(m_step_count, block_cycles) : block_cycles;
+    if (m_step_count < 0 && is_paced())
     {
-      std::this_thread::yield();
+      const uint64_t due = paced_cycles(std::chrono::steady_clock::now());
+      if (due > MAX_PACE_DEBT_CYCLES)
+      {
+        restart_pacing();
+        continue;
+      }
+      cycles = std::min(cycles, due);
     }
+
+    // Commands waiting for the start of the next sample (see commands_due()): stop there
+    if (m_step_count < 0 && m_commands.ready())
+      cycles = std::min(cycles, m_dsp_bench->cycles_until_sample() + 1);
+    run(cycles);
+    if (m_step_count > 0)
+      m_step_count -= cycles;
   }
 }
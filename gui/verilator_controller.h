@@ -3,35 +3,19 @@
 #include "controller.h"
 
 #include "BasicBench.h"
+#include "RAM.h"
 #include "VTestDSP.h"
+#include "command_ring.h"
+#include "triple_buffer.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <string>
 #include <thread>
 #include <variant>
-
-class RAM
-{
-private:
-  std::array<u8, 64 * 1024> data;
-
-public:
-  void put(u16 addr, u8 val) { data[addr] = val; }
-  void put(u16 addr, u32 length, u8 *source)
-  {
-    memcpy(&data[addr], source, length);
-  }
-  u8 get(u16 addr) { return data[addr]; }
-
-  void load(const char *path)
-  {
-    auto file = fopen(path, "rb");
-    fseek(file, 0, SEEK_END);
-    const u64 file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    fread(&data[0], sizeof(u8), file_size, file);
-    fclose(file);
-  }
-};
+#include <vector>
 
 class VerilatorController : public Controller
 {
@@ -39,7 +23,7 @@ public:
   VerilatorController();
   ~VerilatorController();
 
-  void setAudioQueue(AudioQueue *audio_queue) final { m_audio_queue = audio_queue; }
+  void setAudioQueue(AudioQueue *audio_queue) final;
   AudioQueue *getAudioQueue() final { return m_audio_queue; }
 
   // Retrieve state from the system
@@ -50,34 +34,150 @@ public:
   // Set State
   bool setCPURegister(uint8_t registerIndex, uint8_t value);
   bool setDSPRegister(uint8_t registerIndex, uint8_t value);
-  bool setMemorySpan(uint16_t addressOffset, uint32_t range, uint8_t *data);
+  bool setMemorySpan(uint16_t addressOffset, uint32_t range, const u8 *data, std::shared_ptr<const void> storage);
+  bool setDSPRegisters(const u8 values[128]) final;
+  bool loadState(const APUState &state) final;
 
   // Hardware control
   void singleStep();
   void resume();
   void stop();
-  void setSpeed();
+  void setSpeed(SpeedMode mode, float factor = 1.0f);
   void reset();
 
-  uint64_t getCycleCount() const final { return m_dsp_bench->get_tick_count(); }
+  bool saveSnapshot(const char *path);
+  bool restoreSnapshot(const char *path);
+
+  // Runs until the cycle count reaches 'cycle', then stops
+  void runUntil(uint64_t cycle);
+
+  uint64_t getCycleCount() const final { return m_telemetry.cycles; }
+  float getDutyCycle() final;
+  SimTelemetry *getTelemetry() final { return &m_telemetry; }
 
 private:
-  void sim_thread_func();
+  // Everything the GUI asks of the simulation goes through m_commands, and is applied by the
+  // simulation thread in one batch at the next sample boundary (right away while stopped, stepping
+  // or in slow motion; see commands_due()).
+  struct Command_SetDSPRegValue{
+    u8 dsp_reg;
+    u8 reg_value;
+  };
+
+  struct Command_SetCPURegValue
+  {
+    u8 cpu_reg;
+    u8 reg_value;
+  };
+
+  // As Command_LoadState, the data stays where the caller borrowed it from
+  struct Command_WriteRAM
+  {
+    u16 address;
+    u32 size;
+    const u8 *data;
+    std::shared_ptr<const void> storage;
+  };
+
+  // Written with the backdoor, without clocking the design
+  struct Command_WriteDSPRegisters
+  {
+    std::array<u8, 128> values;
+  };
+
+  // The images stay where the caller's state borrowed them from until the command is run
+  struct Command_LoadState
+  {
+    APUState state;
+  };
+
+  // Sets the run state: step_count cycles, then stop. 0 stops, -1 runs freely.
+  struct Command_Run
+  {
+    int64_t step_count;
+  };
+
+  struct Command_RunUntil
+  {
+    uint64_t cycle;
+  };
+
+  struct Command_SetSpeed
+  {
+    SpeedMode mode;
+    float factor;
+  };
+
+  struct Command_Reset
+  {
+  };
+
+  struct Command_SaveSnapshot
+  {
+    std::string path;
+  };
+
+  struct Command_RestoreSnapshot
+  {
+    std::string path;
+  };
+
+  using UserCommand = std::variant<Command_SetDSPRegValue, Command_SetCPURegValue, Command_WriteRAM,
+                                   Command_WriteDSPRegisters, Command_LoadState, Command_Run, Command_RunUntil,
+                                   Command_SetSpeed, Command_Reset, Command_SaveSnapshot, Command_RestoreSnapshot>;
+
+  struct QueuedCommand
+  {
+    UserCommand command;
+    int64_t queued_ns; // For the command latency telemetry
+  };
 
-  int32_t m_step_count = -1;
-  bool m_quit = false;
+  void sim_thread_func();
+  void run_user_commands();
+  bool can_clock(int64_t step_count) const;
+  bool commands_due() const;
+  bool is_paced() const;
+  void restart_pacing();
+  double paced_cycles_per_sec() const;
+  uint64_t paced_cycles(std::chrono::steady_clock::time_point now) const;
+  uint64_t pace_chunk_cycles() const;
+  std::chrono::steady_clock::time_point pace_deadline() const;
+  void wait_for_work();
+  void push_command(UserCommand command);
+  void publish_dsp_state();
+  void publish_memory();
+
+  // Cycles left to run, or -1 when running freely. Only the simulation thread touches it.
+  int64_t m_step_count = -1;
+
+  // How fast to run freely, as set by Command_SetSpeed, and the audio kept: every m_audio_stride'th
+  // frame, or none if 0. Only the simulation thread touches these.
+  SpeedMode m_speed_mode = SpeedMode_Realtime;
+  float m_speed_factor = 1.0f;
+  uint32_t m_audio_stride = 1;
+
+  // Pacing by the wall clock (see paced_cycles()): the cycles run since m_pace_start
+  std::chrono::steady_clock::time_point m_pace_start = std::chrono::steady_clock::now();
+  uint64_t m_pace_cycles = 0;
+  std::atomic<bool> m_quit = false;
+
+  // Wakes the simulation thread when there is something for it to do. See wait_for_work().
+  SimEvent m_wake;
+
+  // The GUI's window for getDutyCycle()
+  SimDutyCycle m_duty_cycle;
 
   std::thread m_thread;
   std::shared_ptr<BasicBench<VTestDSP>> m_dsp_bench;
   RAM m_ram;
-  AudioQueue *m_audio_queue = nullptr;
+  std::atomic<AudioQueue *> m_audio_queue = nullptr;
 
-  struct Command_SetDSPRegValue{
-    u8 dsp_reg;
-    u8 reg_value;
-  };
+  CommandRing<QueuedCommand, 1024> m_commands;
 
-  using UserCommand = std::variant<Command_SetDSPRegValue>;
-  std::vector<UserCommand> m_user_commands;
-  std::mutex m_user_command_mutex;
+  // What the GUI sees of the simulation. The simulation thread publishes a snapshot of the DSP at
+  // most once per display refresh and whenever it goes to sleep, and of RAM whenever a command
+  // changes it; the model and m_ram are never read from the GUI thread.
+  TripleBuffer<DSPState> m_dsp_state;
+  TripleBuffer<MemoryState> m_memory_state;
+  SimTelemetry m_telemetry;
 };
@@ -0,0 +1,210 @@
+// The whole APU: CPU.v and DSP.v sharing 64 KiB of RAM, with the I/O registers at $F0-$FF that the
+// CPU reaches the DSP, the timers and the SNES through. CPU.v runs at twice the original CPU clock,
+// which is the DSP's clock too (64 clocks per output sample), so everything shares one clock.
+//
+// I/O registers, as on the real APU:
+//   $F1      Control: bits 0-2 enable timers 0-2 (enabling one restarts it)
+//   $F2/$F3  DSP register address and data
+//   $F4-$F7  Ports to the SNES: reads see cpu_port_in, writes go to cpu_port_out
+//   $FA-$FC  Timer targets, 0 meaning 256
+//   $FD-$FF  Timer counters, 4 bits, cleared when read
+// CPU writes to $F0-$FF also land in RAM underneath. Reads of the registers above come from the
+// registers, and everything else reads RAM.
+module APU(
+  input clock,
+  input reset,
+  output signed [15:0] dac_out_l,
+  output signed [15:0] dac_out_r,
+
+  // The SNES side of the ports at $F4-$F7, port i in bits 8*i+7:8*i
+  input  [31:0] cpu_port_in,
+  output [31:0] cpu_port_out,
+
+  output [8*4-1:0] voice_states_out,
+  output cpu_halted,
+
+`ifdef DEBUG_DSP
+  output [7:0] __debug_out_regs [127:0],
+  output [15:0] __debug_voice_cursors [7:0],
+  output signed [15:0] __debug_voice_output [7:0],
+  output [15:0] __debug_voice_ram_address [7:0],
+`endif
+
+  output [5:0] major_step
+);
+
+genvar gi;
+integer i;
+
+// CPU bus. Reads are registered by the RAM, so the I/O registers are too, and the CPU sees
+// whichever of them the address selected on the previous clock.
+wire [15:0] cpu_address;
+wire [7:0] cpu_write_data;
+wire cpu_write_enable;
+wire [7:0] cpu_ram_data;
+reg [7:0] cpu_io_data;
+reg cpu_io_selected;
+
+// DSP bus
+wire [15:0] dsp_ram_address;
+wire [7:0] dsp_ram_data;
+wire dsp_ram_write_enable;
+wire [7:0] dsp_reg_data_out;
+
+/////////////////////////////////////////////
+// I/O registers
+/////////////////////////////////////////////
+
+reg [7:0] control /* verilator public */;                   // $F1
+reg [7:0] dsp_address /* verilator public */;               // $F2
+reg [7:0] port_out [3:0] /* verilator public */;            // $F4-$F7, as written by the CPU
+reg [7:0] timer_target [2:0] /* verilator public */;        // $FA-$FC
+reg [7:0] timer_stage [2:0] /* verilator public */;         // Steps since the counter last went up
+reg [3:0] timer_counter [2:0] /* verilator public */;       // $FD-$FF
+reg [7:0] timer_prescaler;
+reg [15:0] last_cpu_address;
+
+wire io_access = cpu_address[15:4] == 12'h00F;
+wire [3:0] io_register = cpu_address[3:0];
+wire io_port = io_register[3:2] == 2'b01;
+wire io_counter = io_register >= 4'hD;
+wire io_read = io_access && (io_register == 4'h2 || io_register == 4'h3 || io_port || io_counter);
+
+// Timer number of $FA-$FC and $FD-$FF
+wire [1:0] io_timer = io_register[1:0] - (io_counter ? 2'd1 : 2'd2);
+
+// Counters are cleared by the first clock of a read, as CPU.v may hold the address for longer
+wire counter_read = io_access && io_counter && !cpu_write_enable && cpu_address != last_cpu_address;
+
+// DSP registers $80-$FF are read-only mirrors of $00-$7F
+wire dsp_reg_write_enable = cpu_write_enable && io_access && io_register == 4'h3 && !dsp_address[7];
+
+// Timers 0 and 1 step at 8 kHz and timer 2 at 64 kHz, i.e. every 256 and 32 clocks
+wire [2:0] timer_step = {timer_prescaler[4:0] == 5'd31, timer_prescaler == 8'd255, timer_prescaler == 8'd255};
+
+// A target of 0 is reached after 256 steps, when the stage wraps back round to 0
+wire [7:0] timer_next_stage [2:0];
+generate for (gi = 0; gi < 3; gi = gi + 1) begin : timer_stages
+  assign timer_next_stage[gi] = timer_stage[gi] + 8'd1;
+end endgenerate
+
+assign cpu_port_out = {port_out[3], port_out[2], port_out[1], port_out[0]};
+
+always @(posedge clock) begin
+  if (reset) begin
+    control <= 8'h00;
+    dsp_address <= 8'h00;
+    timer_prescaler <= 8'h00;
+    last_cpu_address <= 16'h0000;
+    cpu_io_selected <= 1'b0;
+    cpu_io_data <= 8'h00;
+    for (i = 0; i < 4; i = i + 1)
+      port_out[i] <= 8'h00;
+    for (i = 0; i < 3; i = i + 1) begin
+      timer_target[i] <= 8'h00;
+      timer_stage[i] <= 8'h00;
+      timer_counter[i] <= 4'h0;
+    end
+  end else begin
+    last_cpu_address <= cpu_address;
+    timer_prescaler <= timer_prescaler + 8'd1;
+
+    // Reads
+    cpu_io_selected <= io_read;
+    if (io_port)
+      cpu_io_data <= cpu_port_in[{io_register[1:0], 3'b000} +: 8];
+    else if (io_counter)
+      cpu_io_data <= {4'h0, timer_counter[io_timer]};
+    else if (io_register == 4'h3)
+      cpu_io_data <= dsp_reg_data_out;
+    else
+      cpu_io_data <= dsp_address;
+
+    // Timers
+    for (i = 0; i < 3; i = i + 1) begin
+      if (control[i] && timer_step[i]) begin
+        timer_stage[i] <= timer_next_stage[i];
+        if (timer_next_stage[i] == timer_target[i]) begin
+          timer_stage[i] <= 8'h00;
+          timer_counter[i] <= timer_counter[i] + 4'd1;
+        end
+      end
+    end
+    if (counter_read)
+      timer_counter[io_timer] <= 4'h0;
+
+    // Writes
+    if (cpu_write_enable && io_access) begin
+      case (io_register)
+        4'h1: begin
+          control <= cpu_write_data;
+          for (i = 0; i < 3; i = i + 1) begin
+            if (cpu_write_data[i] && !control[i]) begin
+              timer_stage[i] <= 8'h00;
+              timer_counter[i] <= 4'h0;
+            end
+          end
+        end
+        4'h2: dsp_address <= cpu_write_data;
+        4'h4, 4'h5, 4'h6, 4'h7: port_out[io_register[1:0]] <= cpu_write_data;
+        4'hA, 4'hB, 4'hC: timer_target[io_timer] <= cpu_write_data;
+        default: ;
+      endcase
+    end
+  end
+end
+
+/////////////////////////////////////////////
+// Blocks
+/////////////////////////////////////////////
+
+CPU cpu(
+  .clock(clock),
+  .reset(reset),
+  .out_ram_address(cpu_address),
+  .out_ram_write(cpu_write_data),
+  .in_ram_read(cpu_io_selected ? cpu_io_data : cpu_ram_data),
+  .out_ram_write_enable(cpu_write_enable),
+  .out_halted(cpu_halted)
+);
+
+APURAM ram(
+  .in_cpu_address(cpu_address),
+  .in_cpu_data(cpu_write_data),
+  .out_cpu_data(cpu_ram_data),
+  .in_cpu_we(cpu_write_enable),
+
+  .in_dsp_address(dsp_ram_address),
+  .out_dsp_data(dsp_ram_data),
+
+  .clock(clock)
+);
+
+DSP dsp(
+  .ram_address(dsp_ram_address),
+  .ram_data(dsp_ram_data),
+  .ram_write_enable(dsp_ram_write_enable),
+
+  .dsp_reg_address(dsp_address),
+  .dsp_reg_data_in(cpu_write_data),
+  .dsp_reg_data_out(dsp_reg_data_out),
+  .dsp_reg_write_enable(dsp_reg_write_enable),
+
+`ifdef DEBUG_DSP
+  .__debug_out_regs(__debug_out_regs),
+  .__debug_voice_cursors(__debug_voice_cursors),
+  .__debug_voice_output(__debug_voice_output),
+  .__debug_voice_ram_address(__debug_voice_ram_address),
+`endif
+
+  .clock(clock),
+  .reset(reset),
+
+  .dac_out_l(dac_out_l),
+  .dac_out_r(dac_out_r),
+
+  .voice_states_out(voice_states_out),
+  .major_step(major_step)
+);
+
+endmodule
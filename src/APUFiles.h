@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstring>
+#include <string_view>
+
+#include "MappedFile.h"
+#include "types.h"
+
+// Loaders for the files the benches, tools and GUI feed the APU. Each one maps its file, checks it,
+// and then hands out pointers into the mapping, so that seeding RAM from it is a single copy.
+
+// A raw BRR sample, loaded to the start of RAM. Some dumps start with a 2 byte loop point, which is
+// loaded along with the blocks like the rest of the file.
+class BRRFile
+{
+public:
+  static constexpr u32 BlockSize = 9;
+  static constexpr u32 MaxSize = 64 * 1024;
+
+  // Returns false, with the reason in error(), if the file can't be read or isn't a BRR sample
+  bool open(const char *path)
+  {
+    if (!m_file.open(path))
+      return fail("could not open file");
+    if (m_file.size() == 0)
+      return fail("empty file");
+    if (m_file.size() > MaxSize)
+      return fail("larger than RAM");
+    if (m_file.size() % BlockSize != 0 && !has_loop_header())
+      return fail("not a whole number of BRR blocks");
+    return true;
+  }
+
+  const char *error() const { return m_error; }
+
+  const u8 *data() const { return m_file.data(); }
+  u32 size() const { return (u32)m_file.size(); }
+  bool has_loop_header() const { return m_file.size() % BlockSize == 2; }
+
+private:
+  bool fail(const char *error)
+  {
+    m_file.close();
+    m_error = error;
+    return false;
+  }
+
+  MappedFile m_file;
+  const char *m_error = nullptr;
+};
+
+// An SPC snapshot of the whole APU: CPU registers, 64 KiB of RAM and the DSP registers, with an
+// optional ID666 tag describing the song.
+// https://wiki.superfamicom.org/spc-and-rsn-file-format
+class SPCFile
+{
+public:
+  // Everything up to the end of the DSP registers. The IPL area after them is not used.
+  static constexpr u32 MinSize = 0x10180;
+
+  // Song information. Fields are empty if there is no tag, or it doesn't look like one.
+  struct ID666
+  {
+    std::string_view title;
+    std::string_view game;
+    std::string_view dumper;
+    std::string_view comments;
+    std::string_view artist;
+  };
+
+  // Returns false, with the reason in error(), if the file can't be read or isn't an SPC. A bad
+  // ID666 tag is not an error; the tag is just left empty.
+  bool open(const char *path)
+  {
+    static const char signature[] = "SNES-SPC700 Sound File Data";
+
+    if (!m_file.open(path))
+      return fail("could not open file");
+    if (m_file.size() < MinSize)
+      return fail("too small to be an SPC file");
+
+    const u8 *data = m_file.data();
+    if (memcmp(data, signature, sizeof(signature) - 1) != 0)
+      return fail("missing SPC signature");
+    if (data[0x21] != 26 || data[0x22] != 26)
+      return fail("malformed SPC header");
+    if (data[0x23] != 26 && data[0x23] != 27)
+      return fail("malformed SPC header");
+
+    m_tag = {};
+    if (data[0x23] == 26)
+      read_tag();
+    return true;
+  }
+
+  const char *error() const { return m_error; }
+
+  u16 PC() const { return m_file.data()[0x25] | (m_file.data()[0x26] << 8); }
+  u8 A() const { return m_file.data()[0x27]; }
+  u8 X() const { return m_file.data()[0x28]; }
+  u8 Y() const { return m_file.data()[0x29]; }
+  u8 PSW() const { return m_file.data()[0x2A]; }
+  u8 SP() const { return m_file.data()[0x2B]; }
+
+  // 64 KiB
+  const u8 *ram() const { return m_file.data() + 0x100; }
+  // 128 bytes
+  const u8 *dsp_registers() const { return m_file.data() + 0x10100; }
+
+  const ID666 &tag() const { return m_tag; }
+
+private:
+  bool fail(const char *error)
+  {
+    m_file.close();
+    m_error = error;
+    return false;
+  }
+
+  // The tag comes in a text and a binary flavour, which differ in how the numbers after the
+  // comments are stored and so where the artist is. Text tags only have digits (or nothing) there.
+  void read_tag()
+  {
+    const u8 *data = m_file.data();
+    bool text = true;
+    for (u32 i = 0x9E; i < 0xB1 && text; ++i)
+      text = data[i] == 0 || data[i] == '/' || (data[i] >= '0' && data[i] <= '9');
+
+    ID666 tag;
+    if (read_field(0x2E, 32, tag.title) && read_field(0x4E, 32, tag.game) && read_field(0x6E, 16, tag.dumper) &&
+        read_field(0x7E, 32, tag.comments) && read_field(text ? 0xB1 : 0xB0, 32, tag.artist))
+      m_tag = tag;
+  }
+
+  // A NUL padded string. Returns false if it has control characters, i.e. isn't text.
+  bool read_field(u32 offset, u32 size, std::string_view &field) const
+  {
+    const char *chars = (const char *)m_file.data() + offset;
+    u32 length = 0;
+    while (length < size && chars[length])
+    {
+      if ((u8)chars[length] < 0x20 || chars[length] == 0x7F)
+        return false;
+      ++length;
+    }
+    field = std::string_view(chars, length);
+    return true;
+  }
+
+  MappedFile m_file;
+  ID666 m_tag;
+  const char *m_error = nullptr;
+};
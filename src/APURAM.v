@@ -0,0 +1,32 @@
+
+// The APU's 64 KiB of RAM for simulation, shared by the CPU and the DSP (see APU.v). The devboard
+// keeps using SPC700RAM, whose two synchronous ports map onto block RAM; this one does not.
+//
+// The CPU port reads and writes on the clock edge, like TestRAM. The DSP port only reads, and
+// asynchronously, which is how the DSP benches serve ram_data from the current ram_address.
+module APURAM(
+  input      [15:0] in_cpu_address,
+  input      [7:0]  in_cpu_data,
+  output reg [7:0]  out_cpu_data,
+  input             in_cpu_we,
+
+  input      [15:0] in_dsp_address,
+  output     [7:0]  out_dsp_data,
+
+  input clock
+);
+
+parameter ADDRESS_BITS = 16;
+reg [7:0] memory [(2**ADDRESS_BITS)-1:0] /* verilator public */;
+
+// CPU Port
+always @(posedge clock) begin
+  out_cpu_data <= memory[in_cpu_address];
+  if (in_cpu_we)
+    memory[in_cpu_address] <= in_cpu_data;
+end
+
+// DSP Port
+assign out_dsp_data = memory[in_dsp_address];
+
+endmodule
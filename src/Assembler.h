@@ -1,8 +1,16 @@
 #pragma once
 
 #include <functional>
+#include <cctype>
 #include <cstdint>
 
+#include "SPC700.h"
+
+/*
+ * Writes SPC700 machine code through write_func, starting at address 0. Any
+ * instruction can be emitted by its opcode table entry (see SPC700.h), or
+ * assembled from text. The named methods are shorthands for the common ones.
+ */
 class Assembler
 {
 public:
@@ -17,153 +25,185 @@ public:
 		m_address = address;
 	}
 
+	uint16_t address() const
+	{
+		return m_address;
+	}
+
+	/*
+	 * Emits the instruction with the given opcode, looked up at compile time:
+	 *   emit<spc700_find_opcode("MOV", "d, #i")>(0x12, 0x34)
+	 * Field values are given in the order they are written. A branch offset is
+	 * the raw byte, and m.b is (bit << 13) | address.
+	 */
+	template <int opcode>
+	void emit(const unsigned first = 0, const unsigned second = 0)
+	{
+		static_assert(opcode >= 0 && opcode < 256, "No such SPC700 instruction");
+		encode(opcode, first, second);
+	}
+
+	/*
+	 * Assembles one instruction written as in the opcode table, with numbers
+	 * in place of the placeholders, e.g. "MOV $12, #$34" or "BBS $10.3, $0200".
+	 * Numbers are $hex, 0xhex or decimal, and branches take their target
+	 * address. Returns false if the text matches no instruction, or a branch
+	 * target is out of reach.
+	 */
+	bool assemble(const char *text)
+	{
+		for (unsigned opcode = 0; opcode < 256; ++opcode) {
+			const SPC700Opcode &op = SPC700_OPCODES[opcode];
+			unsigned values[2] = {0, 0};
+			if (!match(op, text, values))
+				continue;
+
+			const SPC700Fields fields = spc700_fields(op);
+			for (unsigned i = 0; i < fields.count; ++i) {
+				if (fields.kind[i] != 'r')
+					continue;
+				const int offset = (int16_t)(uint16_t)(values[i] - m_address - op.length);
+				if (offset < -128 || offset > 127)
+					return false;
+				values[i] = (uint8_t)offset;
+			}
+			encode(opcode, values[0], values[1]);
+			return true;
+		}
+		return false;
+	}
+
 	/* Column 1A */
 
 	void NOP()
 	{
-		write(0x00);
+		emit<spc700_find_opcode("NOP", "")>();
 	}
 
 	void CLP()
 	{
-		write(0x20);
+		emit<spc700_find_opcode("CLRP", "")>();
 	}
 
 	void SEP()
 	{
-		write(0x40);
+		emit<spc700_find_opcode("SETP", "")>();
 	}
 
 	void CLC()
 	{
-		write(0x60);
+		emit<spc700_find_opcode("CLRC", "")>();
 	}
 
 	void SEC()
 	{
-		write(0x80);
+		emit<spc700_find_opcode("SETC", "")>();
 	}
 
 	void CLI()
 	{
-		write(0xA0);
+		emit<spc700_find_opcode("DI", "")>();
 	}
 
 	void SEI()
 	{
-		write(0xC0);
+		emit<spc700_find_opcode("EI", "")>();
 	}
 
 	void CLV()
 	{
-		write(0xE0);
+		emit<spc700_find_opcode("CLRV", "")>();
 	}
 
 	/* Column 2A */
 
 	void BPL(const uint8_t r)
 	{
-		write(0x10);
-		write(r);
+		emit<spc700_find_opcode("BPL", "r")>(r);
 	}
 
 	void BMI(const uint8_t r)
 	{
-		write(0x30);
-		write(r);
+		emit<spc700_find_opcode("BMI", "r")>(r);
 	}
 
 	void BVC(const uint8_t r)
 	{
-		write(0x50);
-		write(r);
+		emit<spc700_find_opcode("BVC", "r")>(r);
 	}
 
 	void BVS(const uint8_t r)
 	{
-		write(0x70);
-		write(r);
+		emit<spc700_find_opcode("BVS", "r")>(r);
 	}
 
 	void BCC(const uint8_t r)
 	{
-		write(0x90);
-		write(r);
+		emit<spc700_find_opcode("BCC", "r")>(r);
 	}
 
 	void BCS(const uint8_t r)
 	{
-		write(0xB0);
-		write(r);
+		emit<spc700_find_opcode("BCS", "r")>(r);
 	}
 
 	void BNE(const uint8_t r)
 	{
-		write(0xD0);
-		write(r);
+		emit<spc700_find_opcode("BNE", "r")>(r);
 	}
 
 	void BEQ(const uint8_t r)
 	{
-		write(0xF0);
-		write(r);
+		emit<spc700_find_opcode("BEQ", "r")>(r);
 	}
 
 	/* Column 3A */
 
 	void ORA(const uint8_t imm)
 	{
-		write(0x08);
-		write(imm);
+		emit<spc700_find_opcode("OR", "A, #i")>(imm);
 	}
 
 	void AND(const uint8_t imm)
 	{
-		write(0x28);
-		write(imm);
+		emit<spc700_find_opcode("AND", "A, #i")>(imm);
 	}
 
 	void EORA(const uint8_t imm)
 	{
-		write(0x48);
-		write(imm);
+		emit<spc700_find_opcode("EOR", "A, #i")>(imm);
 	}
 
 	void CMP(const uint8_t imm)
 	{
-		write(0x68);
-		write(imm);
+		emit<spc700_find_opcode("CMP", "A, #i")>(imm);
 	}
 
 	void ADC(const uint8_t imm)
 	{
-		write(0x88);
-		write(imm);
+		emit<spc700_find_opcode("ADC", "A, #i")>(imm);
 	}
 
 	void SBC(const uint8_t imm)
 	{
-		write(0xA8);
-		write(imm);
+		emit<spc700_find_opcode("SBC", "A, #i")>(imm);
 	}
 
 	void CPX(const uint8_t imm)
 	{
-		write(0xC8);
-		write(imm);
+		emit<spc700_find_opcode("CMP", "X, #i")>(imm);
 	}
 
 	void LDA(const uint8_t imm)
 	{
-		write(0xE8);
-		write(imm);
+		emit<spc700_find_opcode("MOV", "A, #i")>(imm);
 	}
 
-	/* Column missing */
+	/* Column FF */
 
 	void HLT()
 	{
-		write(0xFF);
+		emit<spc700_find_opcode("STOP", "")>();
 	}
 
 private:
@@ -175,4 +215,91 @@ private:
 		m_write_func(m_address, byte);
 		m_address++;
 	}
+
+	/* Writes the opcode, then the fields in their encoded order */
+	void encode(const unsigned opcode, const unsigned first, const unsigned second)
+	{
+		const SPC700Opcode &op = SPC700_OPCODES[opcode];
+		const SPC700Fields fields = spc700_fields(op);
+		uint8_t bytes[3] = {(uint8_t)opcode, 0, 0};
+		for (unsigned i = 0; i < fields.count; ++i) {
+			const unsigned value = i ? second : first;
+			bytes[1 + fields.offset[i]] = (uint8_t)value;
+			if (SPC700Opcode::field_size(fields.kind[i]) == 2)
+				bytes[2 + fields.offset[i]] = (uint8_t)(value >> 8);
+		}
+		for (unsigned i = 0; i < op.length; ++i)
+			write(bytes[i]);
+	}
+
+	static const char *skip_spaces(const char *text)
+	{
+		while (isspace((unsigned char)*text))
+			text++;
+		return text;
+	}
+
+	/* $hex, 0xhex or decimal */
+	static bool parse_number(const char *&text, unsigned *value)
+	{
+		int base = 10;
+		if (*text == '$') {
+			base = 16;
+			text++;
+		} else if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+			base = 16;
+			text += 2;
+		}
+
+		const char *start = text;
+		*value = 0;
+		while (base == 16 ? isxdigit((unsigned char)*text) : isdigit((unsigned char)*text)) {
+			const unsigned digit = isdigit((unsigned char)*text) ? *text - '0' : (tolower(*text) - 'a' + 10);
+			*value = *value * base + digit;
+			if (*value > 0xFFFF)
+				return false;
+			text++;
+		}
+		return text != start;
+	}
+
+	/* Whether 'text' is the instruction 'op', filling in its field values */
+	static bool match(const SPC700Opcode &op, const char *text, unsigned values[2])
+	{
+		text = skip_spaces(text);
+		for (const char *m = op.mnemonic; *m; ++m, ++text)
+			if (toupper((unsigned char)*text) != *m)
+				return false;
+		if (*text && !isspace((unsigned char)*text))
+			return false;
+
+		unsigned field = 0;
+		for (const char *p = op.operands;; ++p) {
+			p = skip_spaces(p);
+			text = skip_spaces(text);
+			if (!*p)
+				return !*text;
+
+			if (!SPC700Opcode::is_field(*p)) {
+				if (toupper((unsigned char)*text++) != *p)
+					return false;
+				continue;
+			}
+
+			unsigned value;
+			if (!parse_number(text, &value))
+				return false;
+			if (*p == 'b') {
+				if (value > 7)
+					return false;
+				values[field - 1] |= value << 13;
+				continue;
+			}
+
+			const unsigned limit = (*p == 'a' || *p == 'r') ? 0xFFFF : (*p == 'm') ? 0x1FFF : 0xFF;
+			if (value > limit)
+				return false;
+			values[field++] = value;
+		}
+	}
 };
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+// A compact fingerprint of rendered stereo audio: an FNV-1a hash of every sample plus peak and RMS
+// levels. The running hash is also recorded at the end of every chunk of 'chunk_frames' frames, so
+// two digests can be compared chunk by chunk: once two renders diverge, every later chunk hash
+// differs too, which lets the first divergent chunk be found by binary search.
+class AudioDigest
+{
+public:
+  static constexpr u32 chunk_frames = 4096;
+
+  void push(s16 left, s16 right)
+  {
+    mix(left);
+    mix(right);
+
+    const s32 l = left < 0 ? -left : left;
+    const s32 r = right < 0 ? -right : right;
+    if (l > m_peak)
+      m_peak = l;
+    if (r > m_peak)
+      m_peak = r;
+    m_sum_squares += (double)left * left + (double)right * right;
+
+    if (++m_num_frames % chunk_frames == 0)
+      m_chunk_hashes.push_back(m_hash);
+  }
+
+  // Pushes 'num_frames' interleaved L/R frames.
+  void push(const s16 *samples, u64 num_frames)
+  {
+    for (u64 i = 0; i < num_frames; ++i)
+      push(samples[2 * i], samples[2 * i + 1]);
+  }
+
+  u64 hash() const { return m_hash; }
+  u64 num_frames() const { return m_num_frames; }
+  s32 peak() const { return m_peak; }
+  double rms() const { return m_num_frames ? sqrt(m_sum_squares / (2 * m_num_frames)) : 0.0; }
+
+  // Running hash at the end of each whole chunk
+  const std::vector<u64> &chunk_hashes() const { return m_chunk_hashes; }
+
+  bool operator==(const AudioDigest &other) const
+  {
+    return m_num_frames == other.m_num_frames && m_hash == other.m_hash;
+  }
+  bool operator!=(const AudioDigest &other) const { return !(*this == other); }
+
+  // Index of the first chunk that differs between the two renders. A chunk index equal to the number of
+  // whole chunks they share means that they only differ in the trailing partial chunk (or in length).
+  static size_t first_divergent_chunk(const AudioDigest &a, const AudioDigest &b)
+  {
+    size_t lo = 0;
+    size_t hi = std::min(a.m_chunk_hashes.size(), b.m_chunk_hashes.size());
+    while (lo < hi)
+    {
+      const size_t mid = (lo + hi) / 2;
+      if (a.m_chunk_hashes[mid] == b.m_chunk_hashes[mid])
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  // One line of text: frames, hash, peak, RMS, then the chunk hashes separated by commas.
+  std::string serialize() const
+  {
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "%llu\t%016llx\t%d\t%.2f\t", (unsigned long long)m_num_frames,
+             (unsigned long long)m_hash, m_peak, rms());
+    std::string out = buffer;
+    for (size_t i = 0; i < m_chunk_hashes.size(); ++i)
+    {
+      snprintf(buffer, sizeof(buffer), i ? ",%016llx" : "%016llx", (unsigned long long)m_chunk_hashes[i]);
+      out += buffer;
+    }
+    return out;
+  }
+
+  bool parse(const char *text)
+  {
+    unsigned long long num_frames, hash;
+    double rms;
+    int consumed = 0;
+    if (sscanf(text, "%llu\t%llx\t%d\t%lf\t%n", &num_frames, &hash, &m_peak, &rms, &consumed) != 4)
+      return false;
+
+    m_num_frames = num_frames;
+    m_hash = hash;
+    m_sum_squares = rms * rms * 2 * num_frames;
+    m_chunk_hashes.clear();
+    for (const char *p = text + consumed; *p && *p != '\n';)
+    {
+      char *end;
+      m_chunk_hashes.push_back(strtoull(p, &end, 16));
+      if (end == p)
+        return false;
+      p = (*end == ',') ? end + 1 : end;
+    }
+    return m_chunk_hashes.size() == m_num_frames / chunk_frames;
+  }
+
+private:
+  u64 m_hash = 0xcbf29ce484222325ull;
+  u64 m_num_frames = 0;
+  s32 m_peak = 0;
+  double m_sum_squares = 0;
+  std::vector<u64> m_chunk_hashes;
+
+  void mix(s16 sample)
+  {
+    const u16 bits = sample;
+    m_hash = (m_hash ^ (bits & 0xFF)) * 0x100000001b3ull;
+    m_hash = (m_hash ^ (bits >> 8)) * 0x100000001b3ull;
+  }
+};
+
+// Golden digests of a corpus, keyed by the path of the rendered file. Stored as text, one
+// "path<TAB>digest" line per file, so that changes to it diff cleanly.
+class GoldenDigests
+{
+public:
+  bool load(const char *path)
+  {
+    auto file = fopen(path, "r");
+    if (!file)
+      return false;
+
+    std::string line;
+    char buffer[4096];
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+      line += buffer;
+      if (line.back() != '\n' && !feof(file))
+        continue;
+
+      const size_t tab = line.find('\t');
+      AudioDigest digest;
+      if (line[0] != '#' && tab != std::string::npos && digest.parse(line.c_str() + tab + 1))
+        m_digests[line.substr(0, tab)] = digest;
+      line.clear();
+    }
+    fclose(file);
+    return true;
+  }
+
+  bool save(const char *path) const
+  {
+    auto file = fopen(path, "w");
+    if (!file)
+      return false;
+
+    fprintf(file, "# path\tframes\thash\tpeak\trms\tchunk hashes (every %u frames)\n", AudioDigest::chunk_frames);
+    for (const auto &entry : m_digests)
+      fprintf(file, "%s\t%s\n", entry.first.c_str(), entry.second.serialize().c_str());
+    fclose(file);
+    return true;
+  }
+
+  const AudioDigest *find(const std::string &name) const
+  {
+    const auto it = m_digests.find(name);
+    return it == m_digests.end() ? nullptr : &it->second;
+  }
+
+  void set(const std::string &name, const AudioDigest &digest) { m_digests[name] = digest; }
+  size_t size() const { return m_digests.size(); }
+
+private:
+  std::map<std::string, AudioDigest> m_digests;
+};
@@ -0,0 +1,329 @@
+#pragma once
+
+#include "types.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define BRR_DECODER_X86 1
+#include <immintrin.h>
+#endif
+
+// Decodes BRR blocks for all eight DSP voices in lockstep.
+//
+// A BRR block is one header byte followed by eight data bytes holding 16 signed nibbles. Each
+// nibble is sign extended, shifted left by the header's range (truncated to 16 bits), and then run
+// through one of four ADPCM filters using the two previously decoded samples. The arithmetic is
+// exactly that of DSPVoiceDecoder.v: 32-bit intermediates, coefficients 15/16, 61/32, -15/16,
+// 115/64 and -13/16 with division truncating toward zero, and a 16-bit wrapping result.
+//
+// The filter is recursive along a block, so the parallelism is across voices: voice state is kept
+// structure-of-arrays and every lane of a SIMD register is one voice. Lanes that are not selected in
+// 'lane_mask' keep their filter history untouched and their rows of output are left unspecified.
+
+static constexpr unsigned BRR_LANES = 8;
+static constexpr unsigned BRR_BLOCK_BYTES = 9;
+static constexpr unsigned BRR_BLOCK_SAMPLES = 16;
+
+// Filter history for each lane
+struct BRRDecoderLanes
+{
+  alignas(32) s32 prev0[BRR_LANES]; // Most recently decoded sample
+  alignas(32) s32 prev1[BRR_LANES]; // Second most recently decoded sample
+
+  void reset(unsigned lane)
+  {
+    prev0[lane] = 0;
+    prev1[lane] = 0;
+  }
+};
+
+using BRRBlockData = u8[BRR_LANES][BRR_BLOCK_BYTES];
+using BRRBlockSamples = s16[BRR_BLOCK_SAMPLES][BRR_LANES];
+
+namespace BRR
+{
+  inline s32 expand_nibble(u8 nibble, u8 range)
+  {
+    const s32 extended = (nibble & 0x8) ? (s32)nibble - 16 : (s32)nibble;
+    return (s16)(u16)((u32)extended << range);
+  }
+
+  inline s32 filter(s32 sample, u8 filter, s32 p0, s32 p1)
+  {
+    switch (filter)
+    {
+    case 1:
+      return sample + p0 * 15 / 16;
+    case 2:
+      return sample + p0 * 61 / 32 + p1 * -15 / 16;
+    case 3:
+      return sample + p0 * 115 / 64 + p1 * -13 / 16;
+    }
+    return sample;
+  }
+
+  inline void decode_blocks_scalar(const BRRBlockData blocks, u8 lane_mask, BRRDecoderLanes &lanes, BRRBlockSamples out)
+  {
+    for (unsigned lane = 0; lane < BRR_LANES; ++lane)
+    {
+      if (!(lane_mask & (1 << lane)))
+        continue;
+
+      const u8 header = blocks[lane][0];
+      const u8 range = header >> 4;
+      const u8 filter_mode = (header >> 2) & 3;
+      s32 p0 = lanes.prev0[lane];
+      s32 p1 = lanes.prev1[lane];
+      for (unsigned i = 0; i < BRR_BLOCK_SAMPLES; ++i)
+      {
+        const u8 byte = blocks[lane][1 + i / 2];
+        const u8 nibble = (i & 1) ? (byte & 0xF) : (byte >> 4);
+        const s16 sample = (s16)(u16)filter(expand_nibble(nibble, range), filter_mode, p0, p1);
+        out[i][lane] = sample;
+        p1 = p0;
+        p0 = sample;
+      }
+      lanes.prev0[lane] = p0;
+      lanes.prev1[lane] = p1;
+    }
+  }
+
+#if BRR_DECODER_X86
+  // Expands every lane's 16 nibbles (sign extended, range shifted) and transposes them so that
+  // 'rows[i]' holds sample i of all eight lanes as 16-bit values.
+  __attribute__((target("sse4.1"))) inline void expand_rows_sse41(const BRRBlockData blocks, __m128i rows[BRR_BLOCK_SAMPLES])
+  {
+    const __m128i low_nibbles = _mm_set1_epi8(0x0F);
+    __m128i first[BRR_LANES];  // Samples 0..7 of each lane
+    __m128i second[BRR_LANES]; // Samples 8..15 of each lane
+    for (unsigned lane = 0; lane < BRR_LANES; ++lane)
+    {
+      const __m128i bytes = _mm_loadl_epi64((const __m128i *)&blocks[lane][1]);
+      const __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), low_nibbles);
+      const __m128i lo = _mm_and_si128(bytes, low_nibbles);
+
+      // Nibbles in playback order (high nibble first), sign extended from 4 bits: (n ^ 8) - 8
+      const __m128i eight = _mm_set1_epi8(8);
+      __m128i nibbles = _mm_unpacklo_epi8(hi, lo);
+      nibbles = _mm_sub_epi8(_mm_xor_si128(nibbles, eight), eight);
+
+      const __m128i range = _mm_cvtsi32_si128(blocks[lane][0] >> 4);
+      first[lane] = _mm_sll_epi16(_mm_cvtepi8_epi16(nibbles), range);
+      second[lane] = _mm_sll_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(nibbles, 8)), range);
+    }
+
+    // 8x8 transposes of 16-bit elements
+    auto transpose = [](const __m128i in[8], __m128i out[8])
+    {
+      const __m128i a0 = _mm_unpacklo_epi16(in[0], in[1]);
+      const __m128i a1 = _mm_unpackhi_epi16(in[0], in[1]);
+      const __m128i a2 = _mm_unpacklo_epi16(in[2], in[3]);
+      const __m128i a3 = _mm_unpackhi_epi16(in[2], in[3]);
+      const __m128i a4 = _mm_unpacklo_epi16(in[4], in[5]);
+      const __m128i a5 = _mm_unpackhi_epi16(in[4], in[5]);
+      const __m128i a6 = _mm_unpacklo_epi16(in[6], in[7]);
+      const __m128i a7 = _mm_unpackhi_epi16(in[6], in[7]);
+
+      const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+      const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+      const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+      const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+      const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+      const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+      const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+      const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+      out[0] = _mm_unpacklo_epi64(b0, b4);
+      out[1] = _mm_unpackhi_epi64(b0, b4);
+      out[2] = _mm_unpacklo_epi64(b1, b5);
+      out[3] = _mm_unpackhi_epi64(b1, b5);
+      out[4] = _mm_unpacklo_epi64(b2, b6);
+      out[5] = _mm_unpackhi_epi64(b2, b6);
+      out[6] = _mm_unpacklo_epi64(b3, b7);
+      out[7] = _mm_unpackhi_epi64(b3, b7);
+    };
+    transpose(first, &rows[0]);
+    transpose(second, &rows[8]);
+  }
+
+  // x / 2^shift for signed 32-bit lanes, truncating toward zero like Verilog and C++
+  template <int shift>
+  __attribute__((target("sse4.1"))) inline __m128i div_pow2_sse41(__m128i x)
+  {
+    const __m128i bias = _mm_and_si128(_mm_srai_epi32(x, 31), _mm_set1_epi32((1 << shift) - 1));
+    return _mm_srai_epi32(_mm_add_epi32(x, bias), shift);
+  }
+
+  __attribute__((target("sse4.1"))) inline void decode_blocks_sse41(const BRRBlockData blocks, u8 lane_mask, BRRDecoderLanes &lanes, BRRBlockSamples out)
+  {
+    __m128i rows[BRR_BLOCK_SAMPLES];
+    expand_rows_sse41(blocks, rows);
+
+    // Per-lane filter selection masks. Lanes 0..3 are in [0], lanes 4..7 in [1].
+    __m128i use_filter[4][2];
+    {
+      alignas(16) s32 filters[BRR_LANES];
+      for (unsigned lane = 0; lane < BRR_LANES; ++lane)
+        filters[lane] = (blocks[lane][0] >> 2) & 3;
+      for (unsigned half = 0; half < 2; ++half)
+      {
+        const __m128i f = _mm_load_si128((const __m128i *)&filters[half * 4]);
+        for (int mode = 1; mode < 4; ++mode)
+          use_filter[mode][half] = _mm_cmpeq_epi32(f, _mm_set1_epi32(mode));
+      }
+    }
+
+    const __m128i c15 = _mm_set1_epi32(15);
+    const __m128i c61 = _mm_set1_epi32(61);
+    const __m128i cm15 = _mm_set1_epi32(-15);
+    const __m128i c115 = _mm_set1_epi32(115);
+    const __m128i cm13 = _mm_set1_epi32(-13);
+
+    __m128i p0[2], p1[2];
+    for (unsigned half = 0; half < 2; ++half)
+    {
+      p0[half] = _mm_load_si128((const __m128i *)&lanes.prev0[half * 4]);
+      p1[half] = _mm_load_si128((const __m128i *)&lanes.prev1[half * 4]);
+    }
+
+    for (unsigned i = 0; i < BRR_BLOCK_SAMPLES; ++i)
+    {
+      const __m128i sample[2] = {_mm_cvtepi16_epi32(rows[i]), _mm_cvtepi16_epi32(_mm_srli_si128(rows[i], 8))};
+      __m128i result[2];
+      for (unsigned half = 0; half < 2; ++half)
+      {
+        const __m128i s = sample[half];
+        const __m128i f1 = _mm_add_epi32(s, div_pow2_sse41<4>(_mm_mullo_epi32(p0[half], c15)));
+        const __m128i f2 = _mm_add_epi32(_mm_add_epi32(s, div_pow2_sse41<5>(_mm_mullo_epi32(p0[half], c61))),
+                                         div_pow2_sse41<4>(_mm_mullo_epi32(p1[half], cm15)));
+        const __m128i f3 = _mm_add_epi32(_mm_add_epi32(s, div_pow2_sse41<6>(_mm_mullo_epi32(p0[half], c115))),
+                                         div_pow2_sse41<4>(_mm_mullo_epi32(p1[half], cm13)));
+        __m128i y = s;
+        y = _mm_blendv_epi8(y, f1, use_filter[1][half]);
+        y = _mm_blendv_epi8(y, f2, use_filter[2][half]);
+        y = _mm_blendv_epi8(y, f3, use_filter[3][half]);
+
+        // Wrap to 16 bits
+        y = _mm_srai_epi32(_mm_slli_epi32(y, 16), 16);
+        p1[half] = p0[half];
+        p0[half] = y;
+        result[half] = y;
+      }
+      _mm_storeu_si128((__m128i *)&out[i][0], _mm_packs_epi32(result[0], result[1]));
+    }
+
+    // Only commit history for the lanes that were decoded
+    alignas(16) s32 new_prev0[BRR_LANES];
+    alignas(16) s32 new_prev1[BRR_LANES];
+    for (unsigned half = 0; half < 2; ++half)
+    {
+      _mm_store_si128((__m128i *)&new_prev0[half * 4], p0[half]);
+      _mm_store_si128((__m128i *)&new_prev1[half * 4], p1[half]);
+    }
+    for (unsigned lane = 0; lane < BRR_LANES; ++lane)
+    {
+      if (lane_mask & (1 << lane))
+      {
+        lanes.prev0[lane] = new_prev0[lane];
+        lanes.prev1[lane] = new_prev1[lane];
+      }
+    }
+  }
+
+  template <int shift>
+  __attribute__((target("avx2"))) inline __m256i div_pow2_avx2(__m256i x)
+  {
+    const __m256i bias = _mm256_and_si256(_mm256_srai_epi32(x, 31), _mm256_set1_epi32((1 << shift) - 1));
+    return _mm256_srai_epi32(_mm256_add_epi32(x, bias), shift);
+  }
+
+  __attribute__((target("avx2"))) inline void decode_blocks_avx2(const BRRBlockData blocks, u8 lane_mask, BRRDecoderLanes &lanes, BRRBlockSamples out)
+  {
+    __m128i rows[BRR_BLOCK_SAMPLES];
+    expand_rows_sse41(blocks, rows);
+
+    alignas(32) s32 filters[BRR_LANES];
+    alignas(32) s32 active[BRR_LANES];
+    for (unsigned lane = 0; lane < BRR_LANES; ++lane)
+    {
+      filters[lane] = (blocks[lane][0] >> 2) & 3;
+      active[lane] = (lane_mask & (1 << lane)) ? -1 : 0;
+    }
+    const __m256i f = _mm256_load_si256((const __m256i *)filters);
+    const __m256i use_filter1 = _mm256_cmpeq_epi32(f, _mm256_set1_epi32(1));
+    const __m256i use_filter2 = _mm256_cmpeq_epi32(f, _mm256_set1_epi32(2));
+    const __m256i use_filter3 = _mm256_cmpeq_epi32(f, _mm256_set1_epi32(3));
+
+    const __m256i c15 = _mm256_set1_epi32(15);
+    const __m256i c61 = _mm256_set1_epi32(61);
+    const __m256i cm15 = _mm256_set1_epi32(-15);
+    const __m256i c115 = _mm256_set1_epi32(115);
+    const __m256i cm13 = _mm256_set1_epi32(-13);
+
+    const __m256i old_p0 = _mm256_load_si256((const __m256i *)lanes.prev0);
+    const __m256i old_p1 = _mm256_load_si256((const __m256i *)lanes.prev1);
+    __m256i p0 = old_p0;
+    __m256i p1 = old_p1;
+
+    for (unsigned i = 0; i < BRR_BLOCK_SAMPLES; ++i)
+    {
+      const __m256i s = _mm256_cvtepi16_epi32(rows[i]);
+      const __m256i f1 = _mm256_add_epi32(s, div_pow2_avx2<4>(_mm256_mullo_epi32(p0, c15)));
+      const __m256i f2 = _mm256_add_epi32(_mm256_add_epi32(s, div_pow2_avx2<5>(_mm256_mullo_epi32(p0, c61))),
+                                          div_pow2_avx2<4>(_mm256_mullo_epi32(p1, cm15)));
+      const __m256i f3 = _mm256_add_epi32(_mm256_add_epi32(s, div_pow2_avx2<6>(_mm256_mullo_epi32(p0, c115))),
+                                          div_pow2_avx2<4>(_mm256_mullo_epi32(p1, cm13)));
+      __m256i y = s;
+      y = _mm256_blendv_epi8(y, f1, use_filter1);
+      y = _mm256_blendv_epi8(y, f2, use_filter2);
+      y = _mm256_blendv_epi8(y, f3, use_filter3);
+
+      // Wrap to 16 bits
+      y = _mm256_srai_epi32(_mm256_slli_epi32(y, 16), 16);
+      p1 = p0;
+      p0 = y;
+
+      const __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+      _mm_storeu_si128((__m128i *)&out[i][0], packed);
+    }
+
+    // Only commit history for the lanes that were decoded
+    const __m256i commit = _mm256_load_si256((const __m256i *)active);
+    _mm256_store_si256((__m256i *)lanes.prev0, _mm256_blendv_epi8(old_p0, p0, commit));
+    _mm256_store_si256((__m256i *)lanes.prev1, _mm256_blendv_epi8(old_p1, p1, commit));
+  }
+#endif
+
+  using DecodeBlocksFunc = void (*)(const BRRBlockData, u8, BRRDecoderLanes &, BRRBlockSamples);
+
+  // Picks the widest kernel supported by the host CPU
+  inline DecodeBlocksFunc select_decode_blocks()
+  {
+#if BRR_DECODER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      return decode_blocks_avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+      return decode_blocks_sse41;
+#endif
+    return decode_blocks_scalar;
+  }
+
+  inline const char *kernel_name(DecodeBlocksFunc func)
+  {
+#if BRR_DECODER_X86
+    if (func == decode_blocks_avx2)
+      return "avx2";
+    if (func == decode_blocks_sse41)
+      return "sse4.1";
+#endif
+    return "scalar";
+  }
+};
+
+// Decodes one block for every lane in 'lane_mask', using the best kernel for this CPU. 'blocks'
+// holds each lane's header followed by its eight data bytes.
+inline void brr_decode_blocks(const BRRBlockData blocks, u8 lane_mask, BRRDecoderLanes &lanes, BRRBlockSamples out)
+{
+  static const BRR::DecodeBlocksFunc decode_blocks = BRR::select_decode_blocks();
+  decode_blocks(blocks, lane_mask, lanes, out);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "types.h"
+
+// Zero-tick state injection. These write straight into the 'verilator public' state of a model,
+// instead of going through its ports and clocking it, so no simulated time passes and nothing that
+// reacts to a write (e.g. the DSP's register write logic) runs. Call eval() on the top module
+// afterwards to bring the outputs that depend on the new state up to date.
+
+// Sets all 128 registers of a DSP, e.g. *top.TestDSP->dsp
+template <class DSP>
+void backdoor_write_dsp_registers(DSP &dsp, const u8 *values)
+{
+  for (u32 i = 0; i < 128; ++i)
+    dsp._regs[i] = values[i];
+}
+
+// Sets one register of a DSP, as a write through its register port would on the next clock
+template <class DSP>
+void backdoor_write_dsp_register(DSP &dsp, u8 index, u8 value)
+{
+  dsp._regs[index & 0x7F] = value;
+}
+
+// CPU.v numbers its PSW flags the other way round to the hardware (PSW_N = 0 ... PSW_C = 7), so
+// converting either way reverses the bits
+inline u8 reverse_cpu_flags(u8 psw)
+{
+  u8 reversed = 0;
+  for (u32 i = 0; i < 8; ++i)
+  {
+    if (psw & (1 << i))
+      reversed |= 0x80 >> i;
+  }
+  return reversed;
+}
+
+// Sets the programmer-visible registers of a CPU, e.g. *top.CPUBench->cpu. PSW is in CPU.v's
+// layout; see reverse_cpu_flags(). The CPU must be where reset leaves it, waiting on its first
+// fetch (e.g. straight after BasicBench::reset()), so that the fetch goes to the new PC.
+template <class CPU>
+void backdoor_write_cpu_registers(CPU &cpu, u16 PC, u8 A, u8 X, u8 Y, u8 SP, u8 PSW)
+{
+  // Register file indexes, from CPU.v
+  enum
+  {
+    REGISTER_A = 0,
+    REGISTER_X = 1,
+    REGISTER_Y = 2,
+    REGISTER_SP = 3,
+  };
+
+  // CPU.v fetches through fetch_pc and the address it drives, and only updates PC as it decodes
+  cpu.PC = PC;
+  cpu.fetch_pc = PC;
+  cpu.ram_address = PC;
+  cpu.R[REGISTER_A] = A;
+  cpu.R[REGISTER_X] = X;
+  cpu.R[REGISTER_Y] = Y;
+  cpu.R[REGISTER_SP] = SP;
+  cpu.PSW = PSW;
+}
+
+// Copies 'length' bytes into a RAM model's memory at 'address', e.g. *top.CPUBench->ram
+template <class TestRAM>
+void backdoor_write_ram(TestRAM &ram, u16 address, u32 length, const u8 *data)
+{
+  for (u32 i = 0; i < length; ++i)
+    ram.memory[address + i] = data[i];
+}
+
+// Sets the I/O registers of an APU from the 16 bytes at $F0-$FF of an SPC file's RAM, e.g. *top.APU.
+// Timers restart their current step.
+template <class APU>
+void backdoor_write_apu_io(APU &apu, const u8 *io)
+{
+  apu.control = io[0x1];
+  apu.dsp_address = io[0x2];
+  for (u32 i = 0; i < 3; ++i)
+  {
+    apu.timer_target[i] = io[0xA + i];
+    apu.timer_stage[i] = 0;
+    apu.timer_counter[i] = io[0xD + i] & 0xF;
+  }
+}
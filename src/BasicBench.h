@@ -1,6 +1,89 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.h"
 #include "verilated.h"
+#include "verilated_save.h"
+
+// Whether a model has a ram_data input for the bench to drive. Models verilated with DPI_RAM read
+// memory themselves and have none.
+template <class Module, class = void>
+struct has_ram_data_port : std::false_type
+{
+};
+
+template <class Module>
+struct has_ram_data_port<Module, std::void_t<decltype(std::declval<Module &>().ram_data = 0)>> : std::true_type
+{
+};
+
+// Serializes a model verilated with --savable into memory, through the same operator<< that
+// VerilatedSave uses
+class VerilatedBufferSave : public VerilatedSerialize
+{
+public:
+  VerilatedBufferSave() { m_isOpen = true; }
+
+  void flush() override
+  {
+    m_data.insert(m_data.end(), m_bufp, m_cp);
+    m_cp = m_bufp;
+  }
+
+  // Everything written so far
+  const std::vector<uint8_t> &data()
+  {
+    flush();
+    return m_data;
+  }
+
+private:
+  std::vector<uint8_t> m_data;
+};
+
+// Deserializes a model from memory written by VerilatedBufferSave. Like VerilatedRestore, reading
+// past the end gives zeros, so check the size first.
+class VerilatedBufferRestore : public VerilatedDeserialize
+{
+public:
+  VerilatedBufferRestore(const uint8_t *data, uint64_t size)
+      : m_next(data), m_end(data + size)
+  {
+    m_isOpen = true;
+    m_endp = m_bufp;
+  }
+
+protected:
+  void fill() override
+  {
+    // Keep what hasn't been read yet, and top the buffer up after it
+    const size_t unread = m_endp - m_cp;
+    memmove(m_bufp, m_cp, unread);
+    m_cp = m_bufp;
+    m_endp = m_bufp + unread;
+
+    const size_t count = std::min<size_t>(m_end - m_next, bufferSize() - unread);
+    memcpy(m_endp, m_next, count);
+    m_next += count;
+    m_endp += count;
+    if (m_next == m_end)
+    {
+      memset(m_endp, 0, m_bufp + bufferSize() - m_endp);
+      m_endp = m_bufp + bufferSize();
+    }
+  }
+
+private:
+  const uint8_t *m_next;
+  const uint8_t *const m_end;
+};
 
 template <class Module>
 class BasicBench
@@ -12,6 +95,14 @@ public:
     return;
   }
 
+  // Makes the model in 'context' rather than the default one, e.g. to give a model verilated with
+  // --threads its own thread pool.
+  explicit BasicBench(VerilatedContext *context)
+      : m_tick(0), m_module(new Module(context))
+  {
+    return;
+  }
+
   ~BasicBench()
   {
     delete m_module;
@@ -26,6 +117,7 @@ public:
     m_module->reset = 0;
     m_module->clock = 0;
     m_module->eval();
+    serve_ram();
 
     m_tick = 0;
   }
@@ -36,6 +128,7 @@ public:
     m_module->clock = 1;
     m_module->eval();
     m_module->clock = 0;
+    serve_ram();
 
     ++m_tick;
   }
@@ -72,7 +165,196 @@ public:
 
   uint64_t get_tick_count() const { return m_tick; }
 
+  static constexpr uint64_t cycles_per_sample = 64;
+
+  // Cycles run() will clock before its next call to on_sample. 0 at a sample boundary.
+  uint64_t cycles_until_sample() const
+  {
+    return (cycles_per_sample - 1 - m_module->major_step) % cycles_per_sample;
+  }
+
+  // Memory that reset(), tick() and run() serve the model's ram_address/ram_data port from, if any.
+  // It must stay valid for as long as the bench is clocked with it attached. Unused by models without
+  // a ram_data port, which read the RAM bound with RAM::bind_dpi() instead.
+  void attach_ram(const uint8_t *ram) { m_ram = ram; }
+
+  // Clocks the model 'num_cycles' times, serving its RAM reads from the attached memory after every
+  // clock, as the benches do around tick(). 'on_sample(left, right)' is called with the DAC outputs
+  // at every sample boundary, i.e. before the clock of each cycle that starts with major_step at 63.
+  // major_step is a free-running counter, so the boundaries are computed up front and the inner loop
+  // has no per-cycle checks.
+  template <class OnSample>
+  void run(uint64_t num_cycles, OnSample &&on_sample)
+  {
+    uint64_t until_sample = cycles_until_sample();
+    while (until_sample < num_cycles)
+    {
+      run_cycles(until_sample);
+      num_cycles -= until_sample;
+      on_sample((int16_t)m_module->dac_out_l, (int16_t)m_module->dac_out_r);
+      until_sample = cycles_per_sample;
+    }
+    run_cycles(num_cycles);
+  }
+
+  // Registers memory outside of the model (e.g. the RAM the bench serves reads from) to be saved and
+  // restored along with it. Regions must be registered in the same order when restoring.
+  void add_checkpoint_region(void *data, uint64_t size)
+  {
+    m_checkpoint_regions.push_back({data, size});
+  }
+
+  // Saves the model state, tick counter and checkpoint regions to 'path'. The model must have been
+  // verilated with --savable. Returns false if the file could not be written.
+  bool save(const char *path)
+  {
+    VerilatedBufferSave model;
+    model << *m_module;
+    const std::vector<uint8_t> &model_data = model.data();
+
+    CheckpointHeader header = {};
+    memcpy(header.magic, CheckpointMagic, sizeof(header.magic));
+    header.version = CheckpointVersion;
+    header.num_regions = (uint32_t)m_checkpoint_regions.size();
+    header.model_id = model_id();
+    header.model_bytes = model_data.size();
+    header.tick = m_tick;
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+      return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (const CheckpointRegion &region : m_checkpoint_regions)
+      ok = ok && fwrite(&region.size, sizeof(region.size), 1, file) == 1;
+    for (const CheckpointRegion &region : m_checkpoint_regions)
+      ok = ok && fwrite(region.data, 1, region.size, file) == region.size;
+    ok = ok && fwrite(model_data.data(), 1, model_data.size(), file) == model_data.size();
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+  }
+
+  // Restores a checkpoint written by save(). The whole file is checked before any of it is applied,
+  // so this either restores everything or returns false with the bench untouched: if the file can't
+  // be read, is truncated, or was saved from another model or with other checkpoint regions.
+  bool restore(const char *path)
+  {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(CheckpointHeader))
+      return false;
+
+    CheckpointHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, CheckpointMagic, sizeof(header.magic)) != 0 || header.version != CheckpointVersion ||
+        header.num_regions != m_checkpoint_regions.size() || header.model_id != model_id())
+      return false;
+
+    // The region sizes, then the regions and the model, must account for the rest of the file
+    uint64_t expected = sizeof(header) + header.num_regions * sizeof(uint64_t);
+    if (file.size() < expected)
+      return false;
+    const uint8_t *sizes = file.data() + sizeof(header);
+    for (uint32_t i = 0; i < header.num_regions; ++i)
+    {
+      uint64_t size;
+      memcpy(&size, sizes + i * sizeof(size), sizeof(size));
+      if (size != m_checkpoint_regions[i].size)
+        return false;
+      expected += size;
+    }
+    if (file.size() < expected || file.size() - expected != header.model_bytes)
+      return false;
+
+    // A model's state has a fixed size, so one saved from this model serializes to as many bytes as
+    // it does now. Anything else would make VerilatedDeserialize call vl_fatal, or read zeros.
+    VerilatedBufferSave current;
+    current << *m_module;
+    if (current.data().size() != header.model_bytes)
+      return false;
+
+    const uint8_t *data = sizes + header.num_regions * sizeof(uint64_t);
+    for (const CheckpointRegion &region : m_checkpoint_regions)
+    {
+      memcpy(region.data, data, region.size);
+      data += region.size;
+    }
+    VerilatedBufferRestore model(data, header.model_bytes);
+    model >> *m_module;
+    m_tick = header.tick;
+    return true;
+  }
+
 private:
+  void serve_ram()
+  {
+    if constexpr (has_ram_data_port<Module>::value)
+    {
+      if (m_ram)
+        m_module->ram_data = m_ram[m_module->ram_address];
+    }
+  }
+
+  // As tick() 'num_cycles' times, with serve_ram()'s check made once rather than every cycle
+  void run_cycles(uint64_t num_cycles)
+  {
+    if constexpr (has_ram_data_port<Module>::value)
+    {
+      if (m_ram)
+      {
+        Module *const module = m_module;
+        const uint8_t *const ram = m_ram;
+        clock_cycles(num_cycles, [=]() { module->ram_data = ram[module->ram_address]; });
+        return;
+      }
+    }
+    clock_cycles(num_cycles, []() {});
+  }
+
+  template <class AfterClock>
+  void clock_cycles(uint64_t num_cycles, AfterClock after_clock)
+  {
+    Module *const module = m_module;
+    for (uint64_t i = 0; i < num_cycles; ++i)
+    {
+      module->eval();
+      module->clock = 1;
+      module->eval();
+      module->clock = 0;
+      after_clock();
+    }
+    m_tick += num_cycles;
+  }
+
+  struct CheckpointRegion
+  {
+    void *data;
+    uint64_t size;
+  };
+
+  // A checkpoint file is this header, the size of each region, the regions, and then the model as
+  // its operator<< serializes it
+  struct CheckpointHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_regions;
+    uint64_t model_id; // See model_id()
+    uint64_t model_bytes;
+    uint64_t tick;
+  };
+  static constexpr char CheckpointMagic[8] = {'B', 'E', 'N', 'C', 'H', 'C', 'K', 'P'};
+  static constexpr uint32_t CheckpointVersion = 1;
+
+  // Tells models apart by their C++ type, e.g. VTestDSP from VTestDSP_DPI (FNV-1a of its name)
+  static uint64_t model_id()
+  {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char *c = typeid(Module).name(); *c; ++c)
+      hash = (hash ^ (uint8_t)*c) * 0x100000001b3ull;
+    return hash;
+  }
+
   uint64_t m_tick;
   Module *const m_module;
+  const uint8_t *m_ram = nullptr;
+  std::vector<CheckpointRegion> m_checkpoint_regions;
 };
@@ -31,9 +31,9 @@ module CPU(
 	/*
 	 * Data: CPU Registers
 	 */
-	reg [15:0] PC;     /* Program Counter */
-	reg [7:0] R [3:0]; /* Register File (see below) */
-	reg [7:0] PSW;     /* Status register */
+	reg [15:0] PC /* verilator public */;     /* Program Counter */
+	reg [7:0] R [3:0] /* verilator public */; /* Register File (see below) */
+	reg [7:0] PSW /* verilator public */;     /* Status register */
 
 	/*
 	 * Data: Generic CPU state
@@ -89,7 +89,7 @@ module CPU(
 	/*
 	 * Memory bus control
 	 */
-	reg [15:0] ram_address;
+	reg [15:0] ram_address /* verilator public */;
 	reg [7:0] ram_write;
 	reg ram_write_enable;
 
@@ -556,7 +556,7 @@ module CPU(
 	 */
 	reg [3:0]  state;              /* Current CPU state (see below) */
 	reg [2:0]  bus_state;          /* Memory bus state (see below) */
-	reg [15:0] fetch_pc;           /* Intermediate PC during fetching */
+	reg [15:0] fetch_pc /* verilator public */; /* Intermediate PC during fetching */
 
 	/*
 	 * Bit indexes for `state` that determine the current CPU operation. Uses
@@ -703,6 +703,10 @@ module CPU(
 			/* If branching, this will be updated by the execution stage. */
 			fetch_pc <= fetch_pc_next;
 
+			/* Architectural PC: the instruction being decoded, so once the
+			 * one before it retires PC points past it. */
+			PC <= fetch_pc;
+
 			case (decode_source_u_mode)
 				DATA_R: begin
 					scratch_U <= { 8'b0000_0000, R[decode_source_u_index] };
@@ -736,8 +740,12 @@ module CPU(
 			D_alu_mode <= decode_alu_mode;
 			D_alu_enable <= decode_alu_enable;
 
-			if (decode_source_fetch == DECODE_IMM_NONE) begin
-				state <= (1 << STATE_DECODE); /* TODO */
+			if (decode_source_fetch[DECODE_IMM_NONE]) begin
+				/* Nothing more to fetch: put the next opcode on the bus. The
+				 * fetch state waits for it to come back. */
+				/* TODO Execute before fetching the next instruction */
+				ram_address <= fetch_pc_next;
+				state <= (1 << STATE_FETCH);
 			end else begin
 				state <= (1 << STATE_FETCH_IMM);
 			end
@@ -747,6 +755,28 @@ module CPU(
 		end
 	end
 
+	/*
+	 * Instruction retire, for co-simulation against a reference model.
+	 * `retire` pulses for one cycle after each instruction but the first
+	 * is decoded, i.e. once the one before it has finished updating the
+	 * registers.
+	 */
+	reg retire /* verilator public */;
+	reg decoded_any;
+
+	always @(posedge clock)
+	begin
+		if (reset == 1'b1) begin
+			retire <= 1'b0;
+			decoded_any <= 1'b0;
+		end else begin
+			retire <= enable && state[STATE_DECODE] && decoded_any;
+			if (enable && state[STATE_DECODE]) begin
+				decoded_any <= 1'b1;
+			end
+		end
+	end
+
 	/*
 	 * Immediate byte(s) fetch
 	 */
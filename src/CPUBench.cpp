@@ -1,87 +1,111 @@
+#include <chrono>
 #include <string>
 #include <cstdint>
+#include <cstring>
 
-#include "BasicBench.h"
-#include "VCPUBench.h"
-#include "VCPUBench_CPU.h"
-#include "VCPUBench_CPUBench.h"
-#include "VCPUBench_TestRAM.h"
 #include "Assembler.h"
-
-class CPUBench : public BasicBench<VCPUBench> {
-public:
-	CPUBench()
-	{
-		return;
-	}
-
-	void ram_write(const uint16_t address, const uint8_t data)
-	{
-		(*this)->CPUBench->ram->memory[address] = data;
-	}
-
-	uint8_t ram_read(const uint16_t address) const
-	{
-		return static_cast<uint8_t>((*this)->CPUBench->ram->memory[address]);
-	}
-
-	void print() const
-	{
-		printf("======== %d Ticks ========\n", this->time());
-		(*this)->CPUBench->cpu->debug_print_registers();
-		printf("----\n");
-		(*this)->CPUBench->cpu->debug_print_decode();
-		printf("----\n");
-		(*this)->CPUBench->cpu->debug_print_status();
-		printf("MemD:   %02x\n", (*this)->out_ram_read);
-		printf("\n");
-	}
-
-	void memory_dump() const
-	{
-		for (unsigned i = 0; i < 16; ++i) {
-			printf("%04x:", i * 16);
-			for (unsigned j = 0; j < 16; ++j) {
-				printf(" %02x", ram_read(i * 16 + j));
-			}
-			printf("\n");
-		}
-		printf("\n");
-	}
-};
+#include "CPUBench.h"
+#include "RAM.h"
 
 int
 main(int argc, char **argv, char **env)
 {
 	Verilated::commandArgs(argc, argv);
+
+	bool lockstep = false;
+	unsigned max_instructions = 1000000;
+	const char *program_path = nullptr;
+	const char *trace_path = nullptr;
+	bool trace_delta = false;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--lockstep"))
+			lockstep = true;
+		else if (!strncmp(argv[i], "--trace=", 8))
+			trace_path = argv[i] + 8;
+		else if (!strcmp(argv[i], "--trace-delta"))
+			trace_delta = true;
+		else if (!strncmp(argv[i], "--instructions=", 15))
+			max_instructions = strtoul(argv[i] + 15, nullptr, 0);
+		else if (argv[i][0] != '+')
+			program_path = argv[i];
+	}
+
 	CPUBench bench;
+	CPUModel model;
 	Assembler assembler([&](uint16_t address, uint8_t value) {
 		bench.ram_write(address, value);
+		model.ram[address] = value;
 	});
 
 	bench.reset();
 
+	if (program_path) {
+		/* CPU.v starts at 0, so the program is loaded there */
+		RAM ram;
+		if (!ram.load(program_path)) {
+			printf("Could not load %s\n", program_path);
+			return 1;
+		}
+		for (unsigned address = 0; address < RAM::size(); ++address) {
+			bench.ram_write(address, ram.get(address));
+			model.ram[address] = ram.get(address);
+		}
+	} else {
 #if 0
-	// assembler.ORA(0xFF);
-	// assembler.AND(0x0F);
-	// assembler.EORA(0x11);
-	assembler.LDA(0x34);
-	assembler.ADC(0x10);
-	// assembler.SEP();
-	// assembler.SEC();
-	// assembler.SEI();
-	assembler.CLP();
-	assembler.CLC();
-	assembler.CLI();
-	assembler.SBC(0x14);
-	// assembler.BEQ(0xfe);
-	assembler.HLT();
+		// assembler.ORA(0xFF);
+		// assembler.AND(0x0F);
+		// assembler.EORA(0x11);
+		assembler.LDA(0x34);
+		assembler.ADC(0x10);
+		// assembler.SEP();
+		// assembler.SEC();
+		// assembler.SEI();
+		assembler.CLP();
+		assembler.CLC();
+		assembler.CLI();
+		assembler.SBC(0x14);
+		// assembler.BEQ(0xfe);
+		assembler.HLT();
 #else
-	assembler.LDA(0x10);
-	assembler.SBC(0x01);
-	assembler.BNE(0xfc);
-	assembler.HLT();
+		assembler.LDA(0x10);
+		assembler.SBC(0x01);
+		assembler.BNE(0xfc);
+		assembler.HLT();
 #endif
+	}
+
+	CPUTraceWriter trace;
+	if (trace_path && !trace.open(trace_path, trace_delta)) {
+		printf("Could not write %s\n", trace_path);
+		return 1;
+	}
+
+	if (lockstep) {
+		model.set_registers(bench.PC(), bench.A(), bench.X(), bench.Y(), bench.SP(), bench.PSW());
+		const CPULockstepResult result = cpu_lockstep(bench, model, max_instructions,
+		                                              trace_path ? &trace : nullptr);
+		print_lockstep_result(result, bench, model);
+		if (trace_path && !trace.close()) {
+			printf("Failed to write the whole trace\n");
+			return 1;
+		}
+		return result.ok() ? 0 : 1;
+	}
+
+	/* Tracing replaces the per-tick register dump, which is far too slow for long runs */
+	if (trace_path) {
+		const auto start = std::chrono::steady_clock::now();
+		const uint64_t instructions = cpu_trace_run(bench, trace, max_instructions);
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (!trace.close()) {
+			printf("Failed to write the whole trace\n");
+			return 1;
+		}
+		printf("Traced %llu instructions in %llu ticks (%.0f instructions/sec)\n",
+		       (unsigned long long)instructions, (unsigned long long)bench.time(),
+		       instructions / elapsed.count());
+		return 0;
+	}
 
 	//while (!bench->out_halted) {
 	for (unsigned i = 0; i < 5; ++i) {
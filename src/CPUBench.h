@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "BasicBench.h"
+#include "Backdoor.h"
+#include "CPUModel.h"
+#include "CPUTrace.h"
+#include "SPC700.h"
+#include "VCPUBench.h"
+#include "VCPUBench_CPU.h"
+#include "VCPUBench_CPUBench.h"
+#include "VCPUBench_TestRAM.h"
+
+/*
+ * The CPU on its own with 64 KiB of RAM (CPUBench.v), and lockstep runs of it
+ * against the reference interpreter (CPUModel.h). Shared by the CPUBench test
+ * and the CPUFuzzer tool.
+ */
+
+class CPUBench : public BasicBench<VCPUBench> {
+public:
+	/* Longest CPU.v may take over one instruction before it is considered stuck */
+	static const unsigned MAX_CYCLES_PER_INSTRUCTION = 64;
+
+	CPUBench()
+	{
+		return;
+	}
+
+	explicit CPUBench(VerilatedContext *context)
+		: BasicBench(context)
+	{
+		return;
+	}
+
+	void ram_write(const uint16_t address, const uint8_t data)
+	{
+		(*this)->CPUBench->ram->memory[address] = data;
+	}
+
+	// Loads a whole 64 KiB memory image and the CPU registers without clocking the design. PSW
+	// is in the hardware's layout, as returned by PSW().
+	void load_state(const uint8_t *ram, uint16_t PC, uint8_t A, uint8_t X, uint8_t Y, uint8_t SP, uint8_t PSW)
+	{
+		backdoor_write_ram(*(*this)->CPUBench->ram, 0, 64 * 1024, ram);
+		backdoor_write_cpu_registers(*(*this)->CPUBench->cpu, PC, A, X, Y, SP, reverse_cpu_flags(PSW));
+		(*this)->eval();
+	}
+
+	uint8_t ram_read(const uint16_t address) const
+	{
+		return static_cast<uint8_t>((*this)->CPUBench->ram->memory[address]);
+	}
+
+	/* Set for one cycle each time CPU.v finishes an instruction */
+	bool retired() const
+	{
+		return (*this)->CPUBench->cpu->retire;
+	}
+
+	/* The instruction CPU.v is decoding, so right after a retire the next one to run */
+	uint16_t PC() const { return (*this)->CPUBench->cpu->PC; }
+	uint8_t A() const { return (*this)->CPUBench->cpu->R[0]; }
+	uint8_t X() const { return (*this)->CPUBench->cpu->R[1]; }
+	uint8_t Y() const { return (*this)->CPUBench->cpu->R[2]; }
+	uint8_t SP() const { return (*this)->CPUBench->cpu->R[3]; }
+
+	/* In the hardware's layout (N is bit 7, C bit 0) */
+	uint8_t PSW() const
+	{
+		return reverse_cpu_flags((*this)->CPUBench->cpu->PSW);
+	}
+
+	void print() const
+	{
+		printf("======== %d Ticks ========\n", this->time());
+		(*this)->CPUBench->cpu->debug_print_registers();
+		printf("----\n");
+		(*this)->CPUBench->cpu->debug_print_decode();
+		printf("----\n");
+		(*this)->CPUBench->cpu->debug_print_status();
+		printf("MemD:   %02x\n", (*this)->out_ram_read);
+		printf("\n");
+	}
+
+	/* The instruction CPU.v has just retired, which started at 'pc' */
+	CPUTraceRecord trace_record(uint16_t pc, uint8_t opcode) const
+	{
+		return {this->time(), pc, opcode, A(), X(), Y(), SP(), PSW()};
+	}
+
+	void memory_dump() const
+	{
+		for (unsigned i = 0; i < 16; ++i) {
+			printf("%04x:", i * 16);
+			for (unsigned j = 0; j < 16; ++j) {
+				printf(" %02x", ram_read(i * 16 + j));
+			}
+			printf("\n");
+		}
+		printf("\n");
+	}
+};
+
+/*
+ * Where a lockstep run stopped, and why.
+ */
+struct CPULockstepResult {
+	enum Outcome {
+		MATCH,        /* Ran to the end, or both halted */
+		MISMATCH,     /* Registers differ after an instruction */
+		NO_RETIRE,    /* CPU.v did not finish an instruction in time */
+		HALTED,       /* CPU.v halted and the model did not */
+		RAM_MISMATCH, /* Registers agree to the end, memory does not */
+	};
+
+	Outcome outcome = MATCH;
+	unsigned instruction = 0; /* Index of the instruction it stopped at */
+	uint16_t pc = 0;          /* ... its address */
+	uint8_t opcode = 0;       /* ... and opcode */
+	uint16_t address = 0;     /* First differing address, for RAM_MISMATCH */
+
+	bool ok() const { return outcome == MATCH; }
+};
+
+/*
+ * Runs CPU.v and the reference interpreter side by side from the same state,
+ * comparing the registers every time CPU.v retires an instruction, and RAM at
+ * the end. Each retired instruction is also written to 'trace', if given.
+ */
+inline CPULockstepResult
+cpu_lockstep(CPUBench &bench, CPUModel &model, unsigned max_instructions, CPUTraceWriter *trace = nullptr)
+{
+	CPULockstepResult result;
+	for (unsigned i = 0; i < max_instructions; ++i) {
+		result.instruction = i;
+		result.pc = model.PC;
+		result.opcode = model.ram[model.PC];
+		model.step();
+
+		unsigned cycles = 0;
+		do {
+			bench.tick();
+			cycles++;
+		} while (!bench.retired() && !bench->out_halted && cycles < CPUBench::MAX_CYCLES_PER_INSTRUCTION);
+
+		if (bench->out_halted && model.halted)
+			break;
+
+		if (!bench.retired()) {
+			result.outcome = bench->out_halted ? CPULockstepResult::HALTED : CPULockstepResult::NO_RETIRE;
+			return result;
+		}
+
+		if (trace)
+			trace->push(bench.trace_record(result.pc, result.opcode));
+
+		if (bench.PC() != model.PC || bench.A() != model.A || bench.X() != model.X ||
+		    bench.Y() != model.Y || bench.SP() != model.SP || bench.PSW() != model.PSW) {
+			result.outcome = CPULockstepResult::MISMATCH;
+			return result;
+		}
+	}
+
+	for (unsigned address = 0; address < model.ram.size(); ++address) {
+		if (bench.ram_read(address) != model.ram[address]) {
+			result.outcome = CPULockstepResult::RAM_MISMATCH;
+			result.address = address;
+			return result;
+		}
+	}
+	return result;
+}
+
+/*
+ * Runs CPU.v on its own until it halts, gets stuck or has retired
+ * max_instructions, writing each instruction to 'trace'. Returns the number
+ * of instructions traced.
+ *
+ * Each record's address is CPU.v's PC as of the previous retire (or the
+ * start), which is the instruction that has retired since, and its opcode
+ * is read before that instruction ran.
+ */
+inline uint64_t
+cpu_trace_run(CPUBench &bench, CPUTraceWriter &trace, uint64_t max_instructions)
+{
+	uint16_t pc = bench.PC();
+	uint8_t opcode = bench.ram_read(pc);
+	uint64_t instructions = 0;
+	unsigned cycles = 0;
+	while (instructions < max_instructions && !bench->out_halted &&
+	       cycles < CPUBench::MAX_CYCLES_PER_INSTRUCTION) {
+		bench.tick();
+		cycles++;
+		if (!bench.retired())
+			continue;
+
+		trace.push(bench.trace_record(pc, opcode));
+		pc = bench.PC();
+		opcode = bench.ram_read(pc);
+		instructions++;
+		cycles = 0;
+	}
+	return instructions;
+}
+
+/*
+ * The instruction a lockstep run stopped at, as text. Read back from the
+ * model's RAM, wrapping at the top.
+ */
+inline void
+lockstep_disassemble(const CPULockstepResult &result, const CPUModel &model, char *text, unsigned size)
+{
+	const uint8_t bytes[3] = {
+		model.ram[result.pc],
+		model.ram[(uint16_t)(result.pc + 1)],
+		model.ram[(uint16_t)(result.pc + 2)],
+	};
+	spc700_disassemble(bytes, result.pc, text, size);
+}
+
+inline void
+print_lockstep_result(const CPULockstepResult &result, const CPUBench &bench, const CPUModel &model)
+{
+	char text[32];
+	lockstep_disassemble(result, model, text, sizeof(text));
+
+	switch (result.outcome) {
+	case CPULockstepResult::MATCH:
+		printf("Lockstep OK: %llu ticks, %llu SPC700 cycles\n", (unsigned long long)bench.time(),
+		       (unsigned long long)model.cycles);
+		return;
+
+	case CPULockstepResult::NO_RETIRE:
+	case CPULockstepResult::HALTED:
+		printf("Instruction %u (%s at %04x): CPU.v %s\n", result.instruction, text,
+		       result.pc, result.outcome == CPULockstepResult::HALTED ? "halted" : "did not retire");
+		return;
+
+	case CPULockstepResult::RAM_MISMATCH:
+		printf("RAM differs at %04x: CPU.v %02x, model %02x\n", result.address,
+		       bench.ram_read(result.address), model.ram[result.address]);
+		return;
+
+	case CPULockstepResult::MISMATCH:
+		printf("Diverged at instruction %u (%s at %04x, tick %llu)\n", result.instruction,
+		       text, result.pc, (unsigned long long)bench.time());
+		printf("           PC   A  X  Y  SP PSW\n");
+		printf("  CPU.v:   %04x %02x %02x %02x %02x %02x\n",
+		       bench.PC(), bench.A(), bench.X(), bench.Y(), bench.SP(), bench.PSW());
+		printf("  model:   %04x %02x %02x %02x %02x %02x\n",
+		       model.PC, model.A, model.X, model.Y, model.SP, model.PSW);
+		return;
+	}
+}
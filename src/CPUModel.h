@@ -0,0 +1,803 @@
+#pragma once
+
+#include <array>
+
+#include "SPC700.h"
+#include "types.h"
+
+// Native C++ reference for CPU.v: an SPC700 interpreter covering all 256 opcodes, with its own
+// 64 KiB of RAM. Unlike the DSP models it is accurate to the instruction rather than the clock;
+// step() runs one whole instruction, which is what the CPU bench compares CPU.v against each time
+// it retires one.
+//
+// Each opcode is dispatched through a table of handlers. Most handlers are templates over the
+// operation and addressing mode, so one definition covers a whole row or column of the opcode map.
+// Behaviour follows the real S-SMP, including its flags for DIV, DAA/DAS and the word operations.
+class CPUModel
+{
+public:
+  // PSW bits
+  enum Flag : u8
+  {
+    FLAG_C = 0x01, // Carry
+    FLAG_Z = 0x02, // Zero
+    FLAG_I = 0x04, // Interrupt enable (no interrupt sources on the APU)
+    FLAG_H = 0x08, // Half carry
+    FLAG_B = 0x10, // Break
+    FLAG_P = 0x20, // Direct page at $0100 instead of $0000
+    FLAG_V = 0x40, // Overflow
+    FLAG_N = 0x80, // Negative
+  };
+
+  u16 PC = 0;
+  u8 A = 0;
+  u8 X = 0;
+  u8 Y = 0;
+  u8 SP = 0;
+  u8 PSW = 0;
+
+  // SPC700 cycles the instructions run so far would have taken, from the opcode table
+  u64 cycles = 0;
+
+  // Set by SLEEP and STOP, after which step() does nothing. PC stays on the instruction.
+  bool halted = false;
+
+  std::array<u8, 64 * 1024> ram = {};
+
+  void set_registers(u16 pc, u8 a, u8 x, u8 y, u8 sp, u8 psw)
+  {
+    PC = pc;
+    A = a;
+    X = x;
+    Y = y;
+    SP = sp;
+    PSW = psw;
+    halted = false;
+  }
+
+  // Runs one instruction
+  void step()
+  {
+    if (halted)
+      return;
+    const u8 opcode = fetch();
+    cycles += SPC700_OPCODES[opcode].cycles;
+    (this->*s_ops[opcode])();
+  }
+
+private:
+  using Op = void (CPUModel::*)();
+  static const Op s_ops[256];
+
+  enum Reg
+  {
+    REG_A,
+    REG_X,
+    REG_Y,
+    REG_SP,
+    REG_PSW,
+  };
+
+  enum Mode
+  {
+    MODE_IMM,      // #i
+    MODE_DP,       // d
+    MODE_DP_X,     // d+X
+    MODE_DP_Y,     // d+Y
+    MODE_ABS,      // !a
+    MODE_ABS_X,    // !a+X
+    MODE_ABS_Y,    // !a+Y
+    MODE_IND_X,    // (X)
+    MODE_IND_DP_X, // [d+X]
+    MODE_IND_DP_Y, // [d]+Y
+  };
+
+  enum Alu
+  {
+    ALU_OR,
+    ALU_AND,
+    ALU_EOR,
+    ALU_CMP,
+    ALU_ADC,
+    ALU_SBC,
+  };
+
+  enum Rmw
+  {
+    RMW_ASL,
+    RMW_ROL,
+    RMW_LSR,
+    RMW_ROR,
+    RMW_DEC,
+    RMW_INC,
+  };
+
+  enum Bit
+  {
+    BIT_OR1,
+    BIT_OR1_NOT,
+    BIT_AND1,
+    BIT_AND1_NOT,
+    BIT_EOR1,
+    BIT_MOV1,
+  };
+
+  /* Memory and stack */
+
+  u8 read(u16 address) const { return ram[address]; }
+  void write(u16 address, u8 value) { ram[address] = value; }
+
+  u8 fetch() { return read(PC++); }
+  u16 fetch16()
+  {
+    const u8 low = fetch();
+    return low | (fetch() << 8);
+  }
+
+  // Direct page addresses wrap within the page
+  u16 dp(u8 offset) const { return ((PSW & FLAG_P) ? 0x100 : 0) | offset; }
+  u16 read16_dp(u8 offset) const { return read(dp(offset)) | (read(dp(offset + 1)) << 8); }
+  void write16_dp(u8 offset, u16 value)
+  {
+    write(dp(offset), (u8)value);
+    write(dp(offset + 1), (u8)(value >> 8));
+  }
+
+  void push(u8 value) { write(0x100 | SP--, value); }
+  u8 pop() { return read(0x100 | ++SP); }
+  void push16(u16 value)
+  {
+    push((u8)(value >> 8));
+    push((u8)value);
+  }
+  u16 pop16()
+  {
+    const u8 low = pop();
+    return low | (pop() << 8);
+  }
+
+  u16 YA() const { return A | (Y << 8); }
+  void set_YA(u16 value)
+  {
+    A = (u8)value;
+    Y = (u8)(value >> 8);
+  }
+
+  template <Reg r>
+  u8 &reg()
+  {
+    if constexpr (r == REG_A)
+      return A;
+    else if constexpr (r == REG_X)
+      return X;
+    else if constexpr (r == REG_Y)
+      return Y;
+    else if constexpr (r == REG_SP)
+      return SP;
+    else
+      return PSW;
+  }
+
+  // Fetches the operand bytes of 'mode' and returns the address they refer to. Immediates are
+  // addressed in place, at PC.
+  template <Mode mode>
+  u16 address()
+  {
+    if constexpr (mode == MODE_IMM)
+      return PC++;
+    else if constexpr (mode == MODE_DP)
+      return dp(fetch());
+    else if constexpr (mode == MODE_DP_X)
+      return dp(fetch() + X);
+    else if constexpr (mode == MODE_DP_Y)
+      return dp(fetch() + Y);
+    else if constexpr (mode == MODE_ABS)
+      return fetch16();
+    else if constexpr (mode == MODE_ABS_X)
+      return fetch16() + X;
+    else if constexpr (mode == MODE_ABS_Y)
+      return fetch16() + Y;
+    else if constexpr (mode == MODE_IND_X)
+      return dp(X);
+    else if constexpr (mode == MODE_IND_DP_X)
+      return read16_dp(fetch() + X);
+    else
+      return read16_dp(fetch()) + Y;
+  }
+
+  /* Flags and arithmetic */
+
+  void set_flag(u8 flag, bool set) { PSW = set ? (PSW | flag) : (PSW & ~flag); }
+  void set_nz(u8 value)
+  {
+    set_flag(FLAG_N, value & 0x80);
+    set_flag(FLAG_Z, value == 0);
+  }
+  void set_nz16(u16 value)
+  {
+    set_flag(FLAG_N, value & 0x8000);
+    set_flag(FLAG_Z, value == 0);
+  }
+
+  u8 adc(u8 a, u8 b)
+  {
+    const u32 result = a + b + (PSW & FLAG_C);
+    set_flag(FLAG_C, result > 0xFF);
+    set_flag(FLAG_H, (a ^ b ^ result) & 0x10);
+    set_flag(FLAG_V, ~(a ^ b) & (a ^ result) & 0x80);
+    set_nz((u8)result);
+    return (u8)result;
+  }
+
+  // Returns the value to write back: unchanged for CMP, which callers don't write
+  template <Alu alu>
+  u8 calc(u8 a, u8 b)
+  {
+    if constexpr (alu == ALU_OR)
+      a |= b;
+    else if constexpr (alu == ALU_AND)
+      a &= b;
+    else if constexpr (alu == ALU_EOR)
+      a ^= b;
+    else if constexpr (alu == ALU_CMP)
+    {
+      set_flag(FLAG_C, a >= b);
+      set_nz(a - b);
+      return a;
+    }
+    else if constexpr (alu == ALU_ADC)
+      return adc(a, b);
+    else
+      return adc(a, ~b);
+    set_nz(a);
+    return a;
+  }
+
+  template <Rmw rmw>
+  u8 modify(u8 value)
+  {
+    if constexpr (rmw == RMW_ASL || rmw == RMW_ROL)
+    {
+      const u8 carry_in = (rmw == RMW_ROL) ? (PSW & FLAG_C) : 0;
+      set_flag(FLAG_C, value & 0x80);
+      value = (value << 1) | carry_in;
+    }
+    else if constexpr (rmw == RMW_LSR || rmw == RMW_ROR)
+    {
+      const u8 carry_in = (rmw == RMW_ROR && (PSW & FLAG_C)) ? 0x80 : 0;
+      set_flag(FLAG_C, value & 0x01);
+      value = (value >> 1) | carry_in;
+    }
+    else if constexpr (rmw == RMW_DEC)
+      value--;
+    else
+      value++;
+    set_nz(value);
+    return value;
+  }
+
+  void branch(bool taken)
+  {
+    const s8 offset = (s8)fetch();
+    if (taken)
+    {
+      PC += offset;
+      cycles += 2;
+    }
+  }
+
+  /* Instruction handlers, grouped as in the opcode table */
+
+  // OR/AND/EOR/CMP/ADC/SBC reg, operand
+  template <Alu alu, Reg r, Mode mode>
+  void op_alu()
+  {
+    const u8 value = read(address<mode>());
+    const u8 result = calc<alu>(reg<r>(), value);
+    if constexpr (alu != ALU_CMP)
+      reg<r>() = result;
+  }
+
+  // OR/AND/EOR/CMP/ADC/SBC d, #i
+  template <Alu alu>
+  void op_alu_dp_imm()
+  {
+    const u8 value = fetch();
+    const u16 target = address<MODE_DP>();
+    const u8 result = calc<alu>(read(target), value);
+    if constexpr (alu != ALU_CMP)
+      write(target, result);
+  }
+
+  // OR/AND/EOR/CMP/ADC/SBC dd, ds
+  template <Alu alu>
+  void op_alu_dp_dp()
+  {
+    const u8 value = read(address<MODE_DP>());
+    const u16 target = address<MODE_DP>();
+    const u8 result = calc<alu>(read(target), value);
+    if constexpr (alu != ALU_CMP)
+      write(target, result);
+  }
+
+  // OR/AND/EOR/CMP/ADC/SBC (X), (Y)
+  template <Alu alu>
+  void op_alu_x_y()
+  {
+    const u8 value = read(dp(Y));
+    const u16 target = dp(X);
+    const u8 result = calc<alu>(read(target), value);
+    if constexpr (alu != ALU_CMP)
+      write(target, result);
+  }
+
+  // MOV reg, operand
+  template <Reg r, Mode mode>
+  void op_load()
+  {
+    reg<r>() = read(address<mode>());
+    set_nz(reg<r>());
+  }
+
+  // MOV operand, reg
+  template <Mode mode, Reg r>
+  void op_store()
+  {
+    write(address<mode>(), reg<r>());
+  }
+
+  // MOV dst, src between registers. Only MOV SP, X leaves the flags alone.
+  template <Reg dst, Reg src>
+  void op_transfer()
+  {
+    reg<dst>() = reg<src>();
+    if constexpr (dst != REG_SP)
+      set_nz(reg<dst>());
+  }
+
+  // ASL/ROL/LSR/ROR/DEC/INC operand
+  template <Rmw rmw, Mode mode>
+  void op_rmw()
+  {
+    const u16 target = address<mode>();
+    write(target, modify<rmw>(read(target)));
+  }
+
+  // ASL/ROL/LSR/ROR/DEC/INC reg
+  template <Rmw rmw, Reg r>
+  void op_rmw_reg()
+  {
+    reg<r>() = modify<rmw>(reg<r>());
+  }
+
+  template <u8 flag, bool set>
+  void op_branch()
+  {
+    branch(((PSW & flag) != 0) == set);
+  }
+
+  template <u8 flag, bool set>
+  void op_flag()
+  {
+    set_flag(flag, set);
+  }
+
+  // SET1/CLR1 d.bit
+  template <u8 bit, bool set>
+  void op_set1()
+  {
+    const u16 target = address<MODE_DP>();
+    const u8 value = read(target);
+    write(target, set ? (value | (1 << bit)) : (value & ~(1 << bit)));
+  }
+
+  // BBS/BBC d.bit, r
+  template <u8 bit, bool set>
+  void op_bbs()
+  {
+    const u8 value = read(address<MODE_DP>());
+    branch(((value >> bit) & 1) == set);
+  }
+
+  template <u8 n>
+  void op_tcall()
+  {
+    const u16 vector = 0xFFDE - 2 * n;
+    push16(PC);
+    PC = read(vector) | (read(vector + 1) << 8);
+  }
+
+  template <Reg r>
+  void op_push()
+  {
+    push(reg<r>());
+  }
+
+  template <Reg r>
+  void op_pop()
+  {
+    reg<r>() = pop();
+  }
+
+  // OR1/AND1/EOR1/MOV1 C, m.bit (or /m.bit)
+  template <Bit op>
+  void op_bit()
+  {
+    const u16 operand = fetch16();
+    const bool bit = (read(operand & 0x1FFF) >> (operand >> 13)) & 1;
+    const bool carry = PSW & FLAG_C;
+    if constexpr (op == BIT_OR1)
+      set_flag(FLAG_C, carry || bit);
+    else if constexpr (op == BIT_OR1_NOT)
+      set_flag(FLAG_C, carry || !bit);
+    else if constexpr (op == BIT_AND1)
+      set_flag(FLAG_C, carry && bit);
+    else if constexpr (op == BIT_AND1_NOT)
+      set_flag(FLAG_C, carry && !bit);
+    else if constexpr (op == BIT_EOR1)
+      set_flag(FLAG_C, carry != bit);
+    else
+      set_flag(FLAG_C, bit);
+  }
+
+  // MOV1 m.bit, C
+  void op_mov1_store()
+  {
+    const u16 operand = fetch16();
+    const u16 target = operand & 0x1FFF;
+    const u8 mask = 1 << (operand >> 13);
+    write(target, (PSW & FLAG_C) ? (read(target) | mask) : (read(target) & ~mask));
+  }
+
+  // NOT1 m.bit
+  void op_not1()
+  {
+    const u16 operand = fetch16();
+    const u16 target = operand & 0x1FFF;
+    write(target, read(target) ^ (1 << (operand >> 13)));
+  }
+
+  // MOV dd, ds
+  void op_mov_dp_dp()
+  {
+    const u8 value = read(address<MODE_DP>());
+    write(address<MODE_DP>(), value);
+  }
+
+  // MOV d, #i
+  void op_mov_dp_imm()
+  {
+    const u8 value = fetch();
+    write(address<MODE_DP>(), value);
+  }
+
+  // MOV (X)+, A
+  void op_store_x_inc() { write(dp(X++), A); }
+
+  // MOV A, (X)+
+  void op_load_x_inc()
+  {
+    A = read(dp(X++));
+    set_nz(A);
+  }
+
+  void op_incw()
+  {
+    const u8 offset = fetch();
+    const u16 value = read16_dp(offset) + 1;
+    write16_dp(offset, value);
+    set_nz16(value);
+  }
+
+  void op_decw()
+  {
+    const u8 offset = fetch();
+    const u16 value = read16_dp(offset) - 1;
+    write16_dp(offset, value);
+    set_nz16(value);
+  }
+
+  void op_addw()
+  {
+    const u32 ya = YA();
+    const u32 value = read16_dp(fetch());
+    const u32 result = ya + value;
+    set_flag(FLAG_C, result > 0xFFFF);
+    set_flag(FLAG_H, (ya ^ value ^ result) & 0x1000);
+    set_flag(FLAG_V, ~(ya ^ value) & (ya ^ result) & 0x8000);
+    set_YA((u16)result);
+    set_nz16((u16)result);
+  }
+
+  void op_subw()
+  {
+    const u32 ya = YA();
+    const u32 value = read16_dp(fetch());
+    const u32 result = ya - value;
+    set_flag(FLAG_C, ya >= value);
+    set_flag(FLAG_H, !((ya ^ value ^ result) & 0x1000));
+    set_flag(FLAG_V, (ya ^ value) & (ya ^ result) & 0x8000);
+    set_YA((u16)result);
+    set_nz16((u16)result);
+  }
+
+  void op_cmpw()
+  {
+    const u16 ya = YA();
+    const u16 value = read16_dp(fetch());
+    set_flag(FLAG_C, ya >= value);
+    set_nz16(ya - value);
+  }
+
+  void op_movw_load()
+  {
+    set_YA(read16_dp(fetch()));
+    set_nz16(YA());
+  }
+
+  void op_movw_store() { write16_dp(fetch(), YA()); }
+
+  // TSET1/TCLR1 !a: flags from A - value, then set or clear A's bits in memory
+  template <bool set>
+  void op_tset1()
+  {
+    const u16 target = address<MODE_ABS>();
+    const u8 value = read(target);
+    set_nz(A - value);
+    write(target, set ? (value | A) : (value & ~A));
+  }
+
+  // CBNE d, r / CBNE d+X, r
+  template <Mode mode>
+  void op_cbne()
+  {
+    const u8 value = read(address<mode>());
+    branch(A != value);
+  }
+
+  void op_dbnz_dp()
+  {
+    const u16 target = address<MODE_DP>();
+    const u8 value = read(target) - 1;
+    write(target, value);
+    branch(value != 0);
+  }
+
+  void op_dbnz_y() { branch(--Y != 0); }
+
+  void op_bra() { branch(true); }
+
+  void op_jmp() { PC = fetch16(); }
+
+  void op_jmp_indirect()
+  {
+    const u16 pointer = fetch16() + X;
+    PC = read(pointer) | (read((u16)(pointer + 1)) << 8);
+  }
+
+  void op_call()
+  {
+    const u16 target = fetch16();
+    push16(PC);
+    PC = target;
+  }
+
+  void op_pcall()
+  {
+    const u8 target = fetch();
+    push16(PC);
+    PC = 0xFF00 | target;
+  }
+
+  void op_brk()
+  {
+    push16(PC);
+    push(PSW);
+    set_flag(FLAG_B, true);
+    set_flag(FLAG_I, false);
+    PC = read(0xFFDE) | (read(0xFFDF) << 8);
+  }
+
+  void op_ret() { PC = pop16(); }
+
+  void op_reti()
+  {
+    PSW = pop();
+    PC = pop16();
+  }
+
+  void op_nop() {}
+
+  // CLRV also clears the half carry
+  void op_clrv() { PSW &= ~(FLAG_V | FLAG_H); }
+
+  void op_notc() { PSW ^= FLAG_C; }
+
+  void op_xcn()
+  {
+    A = (A >> 4) | (A << 4);
+    set_nz(A);
+  }
+
+  void op_mul()
+  {
+    set_YA(Y * A);
+    set_nz(Y);
+  }
+
+  // Quotients over 511 come out as the S-SMP's odd results rather than saturating
+  void op_div()
+  {
+    const u32 ya = YA();
+    const u32 x = X;
+    set_flag(FLAG_V, Y >= X);
+    set_flag(FLAG_H, (Y & 0xF) >= (X & 0xF));
+    if (Y < (x << 1))
+    {
+      A = (u8)(ya / x);
+      Y = (u8)(ya % x);
+    }
+    else
+    {
+      A = (u8)(255 - (ya - (x << 9)) / (256 - x));
+      Y = (u8)(x + (ya - (x << 9)) % (256 - x));
+    }
+    set_nz(A);
+  }
+
+  void op_daa()
+  {
+    if ((PSW & FLAG_C) || A > 0x99)
+    {
+      A += 0x60;
+      set_flag(FLAG_C, true);
+    }
+    if ((PSW & FLAG_H) || (A & 0xF) > 0x9)
+      A += 0x06;
+    set_nz(A);
+  }
+
+  void op_das()
+  {
+    if (!(PSW & FLAG_C) || A > 0x99)
+    {
+      A -= 0x60;
+      set_flag(FLAG_C, false);
+    }
+    if (!(PSW & FLAG_H) || (A & 0xF) > 0x9)
+      A -= 0x06;
+    set_nz(A);
+  }
+
+  // SLEEP and STOP
+  void op_halt()
+  {
+    PC--;
+    halted = true;
+  }
+};
+
+// Indexed by opcode: row is the high nibble, column the low nibble
+inline const CPUModel::Op CPUModel::s_ops[256] = {
+    // 0x00
+    &CPUModel::op_nop, &CPUModel::op_tcall<0>, &CPUModel::op_set1<0, true>, &CPUModel::op_bbs<0, true>,
+    &CPUModel::op_alu<ALU_OR, REG_A, MODE_DP>, &CPUModel::op_alu<ALU_OR, REG_A, MODE_ABS>,
+    &CPUModel::op_alu<ALU_OR, REG_A, MODE_IND_X>, &CPUModel::op_alu<ALU_OR, REG_A, MODE_IND_DP_X>,
+    &CPUModel::op_alu<ALU_OR, REG_A, MODE_IMM>, &CPUModel::op_alu_dp_dp<ALU_OR>, &CPUModel::op_bit<BIT_OR1>,
+    &CPUModel::op_rmw<RMW_ASL, MODE_DP>, &CPUModel::op_rmw<RMW_ASL, MODE_ABS>, &CPUModel::op_push<REG_PSW>,
+    &CPUModel::op_tset1<true>, &CPUModel::op_brk,
+    // 0x10
+    &CPUModel::op_branch<FLAG_N, false>, &CPUModel::op_tcall<1>, &CPUModel::op_set1<0, false>,
+    &CPUModel::op_bbs<0, false>, &CPUModel::op_alu<ALU_OR, REG_A, MODE_DP_X>,
+    &CPUModel::op_alu<ALU_OR, REG_A, MODE_ABS_X>, &CPUModel::op_alu<ALU_OR, REG_A, MODE_ABS_Y>,
+    &CPUModel::op_alu<ALU_OR, REG_A, MODE_IND_DP_Y>, &CPUModel::op_alu_dp_imm<ALU_OR>,
+    &CPUModel::op_alu_x_y<ALU_OR>, &CPUModel::op_decw, &CPUModel::op_rmw<RMW_ASL, MODE_DP_X>,
+    &CPUModel::op_rmw_reg<RMW_ASL, REG_A>, &CPUModel::op_rmw_reg<RMW_DEC, REG_X>,
+    &CPUModel::op_alu<ALU_CMP, REG_X, MODE_ABS>, &CPUModel::op_jmp_indirect,
+    // 0x20
+    &CPUModel::op_flag<FLAG_P, false>, &CPUModel::op_tcall<2>, &CPUModel::op_set1<1, true>,
+    &CPUModel::op_bbs<1, true>, &CPUModel::op_alu<ALU_AND, REG_A, MODE_DP>,
+    &CPUModel::op_alu<ALU_AND, REG_A, MODE_ABS>, &CPUModel::op_alu<ALU_AND, REG_A, MODE_IND_X>,
+    &CPUModel::op_alu<ALU_AND, REG_A, MODE_IND_DP_X>, &CPUModel::op_alu<ALU_AND, REG_A, MODE_IMM>,
+    &CPUModel::op_alu_dp_dp<ALU_AND>, &CPUModel::op_bit<BIT_OR1_NOT>, &CPUModel::op_rmw<RMW_ROL, MODE_DP>,
+    &CPUModel::op_rmw<RMW_ROL, MODE_ABS>, &CPUModel::op_push<REG_A>, &CPUModel::op_cbne<MODE_DP>,
+    &CPUModel::op_bra,
+    // 0x30
+    &CPUModel::op_branch<FLAG_N, true>, &CPUModel::op_tcall<3>, &CPUModel::op_set1<1, false>,
+    &CPUModel::op_bbs<1, false>, &CPUModel::op_alu<ALU_AND, REG_A, MODE_DP_X>,
+    &CPUModel::op_alu<ALU_AND, REG_A, MODE_ABS_X>, &CPUModel::op_alu<ALU_AND, REG_A, MODE_ABS_Y>,
+    &CPUModel::op_alu<ALU_AND, REG_A, MODE_IND_DP_Y>, &CPUModel::op_alu_dp_imm<ALU_AND>,
+    &CPUModel::op_alu_x_y<ALU_AND>, &CPUModel::op_incw, &CPUModel::op_rmw<RMW_ROL, MODE_DP_X>,
+    &CPUModel::op_rmw_reg<RMW_ROL, REG_A>, &CPUModel::op_rmw_reg<RMW_INC, REG_X>,
+    &CPUModel::op_alu<ALU_CMP, REG_X, MODE_DP>, &CPUModel::op_call,
+    // 0x40
+    &CPUModel::op_flag<FLAG_P, true>, &CPUModel::op_tcall<4>, &CPUModel::op_set1<2, true>,
+    &CPUModel::op_bbs<2, true>, &CPUModel::op_alu<ALU_EOR, REG_A, MODE_DP>,
+    &CPUModel::op_alu<ALU_EOR, REG_A, MODE_ABS>, &CPUModel::op_alu<ALU_EOR, REG_A, MODE_IND_X>,
+    &CPUModel::op_alu<ALU_EOR, REG_A, MODE_IND_DP_X>, &CPUModel::op_alu<ALU_EOR, REG_A, MODE_IMM>,
+    &CPUModel::op_alu_dp_dp<ALU_EOR>, &CPUModel::op_bit<BIT_AND1>, &CPUModel::op_rmw<RMW_LSR, MODE_DP>,
+    &CPUModel::op_rmw<RMW_LSR, MODE_ABS>, &CPUModel::op_push<REG_X>, &CPUModel::op_tset1<false>,
+    &CPUModel::op_pcall,
+    // 0x50
+    &CPUModel::op_branch<FLAG_V, false>, &CPUModel::op_tcall<5>, &CPUModel::op_set1<2, false>,
+    &CPUModel::op_bbs<2, false>, &CPUModel::op_alu<ALU_EOR, REG_A, MODE_DP_X>,
+    &CPUModel::op_alu<ALU_EOR, REG_A, MODE_ABS_X>, &CPUModel::op_alu<ALU_EOR, REG_A, MODE_ABS_Y>,
+    &CPUModel::op_alu<ALU_EOR, REG_A, MODE_IND_DP_Y>, &CPUModel::op_alu_dp_imm<ALU_EOR>,
+    &CPUModel::op_alu_x_y<ALU_EOR>, &CPUModel::op_cmpw, &CPUModel::op_rmw<RMW_LSR, MODE_DP_X>,
+    &CPUModel::op_rmw_reg<RMW_LSR, REG_A>, &CPUModel::op_transfer<REG_X, REG_A>,
+    &CPUModel::op_alu<ALU_CMP, REG_Y, MODE_ABS>, &CPUModel::op_jmp,
+    // 0x60
+    &CPUModel::op_flag<FLAG_C, false>, &CPUModel::op_tcall<6>, &CPUModel::op_set1<3, true>,
+    &CPUModel::op_bbs<3, true>, &CPUModel::op_alu<ALU_CMP, REG_A, MODE_DP>,
+    &CPUModel::op_alu<ALU_CMP, REG_A, MODE_ABS>, &CPUModel::op_alu<ALU_CMP, REG_A, MODE_IND_X>,
+    &CPUModel::op_alu<ALU_CMP, REG_A, MODE_IND_DP_X>, &CPUModel::op_alu<ALU_CMP, REG_A, MODE_IMM>,
+    &CPUModel::op_alu_dp_dp<ALU_CMP>, &CPUModel::op_bit<BIT_AND1_NOT>, &CPUModel::op_rmw<RMW_ROR, MODE_DP>,
+    &CPUModel::op_rmw<RMW_ROR, MODE_ABS>, &CPUModel::op_push<REG_Y>, &CPUModel::op_dbnz_dp, &CPUModel::op_ret,
+    // 0x70
+    &CPUModel::op_branch<FLAG_V, true>, &CPUModel::op_tcall<7>, &CPUModel::op_set1<3, false>,
+    &CPUModel::op_bbs<3, false>, &CPUModel::op_alu<ALU_CMP, REG_A, MODE_DP_X>,
+    &CPUModel::op_alu<ALU_CMP, REG_A, MODE_ABS_X>, &CPUModel::op_alu<ALU_CMP, REG_A, MODE_ABS_Y>,
+    &CPUModel::op_alu<ALU_CMP, REG_A, MODE_IND_DP_Y>, &CPUModel::op_alu_dp_imm<ALU_CMP>,
+    &CPUModel::op_alu_x_y<ALU_CMP>, &CPUModel::op_addw, &CPUModel::op_rmw<RMW_ROR, MODE_DP_X>,
+    &CPUModel::op_rmw_reg<RMW_ROR, REG_A>, &CPUModel::op_transfer<REG_A, REG_X>,
+    &CPUModel::op_alu<ALU_CMP, REG_Y, MODE_DP>, &CPUModel::op_reti,
+    // 0x80
+    &CPUModel::op_flag<FLAG_C, true>, &CPUModel::op_tcall<8>, &CPUModel::op_set1<4, true>,
+    &CPUModel::op_bbs<4, true>, &CPUModel::op_alu<ALU_ADC, REG_A, MODE_DP>,
+    &CPUModel::op_alu<ALU_ADC, REG_A, MODE_ABS>, &CPUModel::op_alu<ALU_ADC, REG_A, MODE_IND_X>,
+    &CPUModel::op_alu<ALU_ADC, REG_A, MODE_IND_DP_X>, &CPUModel::op_alu<ALU_ADC, REG_A, MODE_IMM>,
+    &CPUModel::op_alu_dp_dp<ALU_ADC>, &CPUModel::op_bit<BIT_EOR1>, &CPUModel::op_rmw<RMW_DEC, MODE_DP>,
+    &CPUModel::op_rmw<RMW_DEC, MODE_ABS>, &CPUModel::op_load<REG_Y, MODE_IMM>, &CPUModel::op_pop<REG_PSW>,
+    &CPUModel::op_mov_dp_imm,
+    // 0x90
+    &CPUModel::op_branch<FLAG_C, false>, &CPUModel::op_tcall<9>, &CPUModel::op_set1<4, false>,
+    &CPUModel::op_bbs<4, false>, &CPUModel::op_alu<ALU_ADC, REG_A, MODE_DP_X>,
+    &CPUModel::op_alu<ALU_ADC, REG_A, MODE_ABS_X>, &CPUModel::op_alu<ALU_ADC, REG_A, MODE_ABS_Y>,
+    &CPUModel::op_alu<ALU_ADC, REG_A, MODE_IND_DP_Y>, &CPUModel::op_alu_dp_imm<ALU_ADC>,
+    &CPUModel::op_alu_x_y<ALU_ADC>, &CPUModel::op_subw, &CPUModel::op_rmw<RMW_DEC, MODE_DP_X>,
+    &CPUModel::op_rmw_reg<RMW_DEC, REG_A>, &CPUModel::op_transfer<REG_X, REG_SP>, &CPUModel::op_div,
+    &CPUModel::op_xcn,
+    // 0xA0
+    &CPUModel::op_flag<FLAG_I, true>, &CPUModel::op_tcall<10>, &CPUModel::op_set1<5, true>,
+    &CPUModel::op_bbs<5, true>, &CPUModel::op_alu<ALU_SBC, REG_A, MODE_DP>,
+    &CPUModel::op_alu<ALU_SBC, REG_A, MODE_ABS>, &CPUModel::op_alu<ALU_SBC, REG_A, MODE_IND_X>,
+    &CPUModel::op_alu<ALU_SBC, REG_A, MODE_IND_DP_X>, &CPUModel::op_alu<ALU_SBC, REG_A, MODE_IMM>,
+    &CPUModel::op_alu_dp_dp<ALU_SBC>, &CPUModel::op_bit<BIT_MOV1>, &CPUModel::op_rmw<RMW_INC, MODE_DP>,
+    &CPUModel::op_rmw<RMW_INC, MODE_ABS>, &CPUModel::op_alu<ALU_CMP, REG_Y, MODE_IMM>,
+    &CPUModel::op_pop<REG_A>, &CPUModel::op_store_x_inc,
+    // 0xB0
+    &CPUModel::op_branch<FLAG_C, true>, &CPUModel::op_tcall<11>, &CPUModel::op_set1<5, false>,
+    &CPUModel::op_bbs<5, false>, &CPUModel::op_alu<ALU_SBC, REG_A, MODE_DP_X>,
+    &CPUModel::op_alu<ALU_SBC, REG_A, MODE_ABS_X>, &CPUModel::op_alu<ALU_SBC, REG_A, MODE_ABS_Y>,
+    &CPUModel::op_alu<ALU_SBC, REG_A, MODE_IND_DP_Y>, &CPUModel::op_alu_dp_imm<ALU_SBC>,
+    &CPUModel::op_alu_x_y<ALU_SBC>, &CPUModel::op_movw_load, &CPUModel::op_rmw<RMW_INC, MODE_DP_X>,
+    &CPUModel::op_rmw_reg<RMW_INC, REG_A>, &CPUModel::op_transfer<REG_SP, REG_X>, &CPUModel::op_das,
+    &CPUModel::op_load_x_inc,
+    // 0xC0
+    &CPUModel::op_flag<FLAG_I, false>, &CPUModel::op_tcall<12>, &CPUModel::op_set1<6, true>,
+    &CPUModel::op_bbs<6, true>, &CPUModel::op_store<MODE_DP, REG_A>, &CPUModel::op_store<MODE_ABS, REG_A>,
+    &CPUModel::op_store<MODE_IND_X, REG_A>, &CPUModel::op_store<MODE_IND_DP_X, REG_A>,
+    &CPUModel::op_alu<ALU_CMP, REG_X, MODE_IMM>, &CPUModel::op_store<MODE_ABS, REG_X>,
+    &CPUModel::op_mov1_store, &CPUModel::op_store<MODE_DP, REG_Y>, &CPUModel::op_store<MODE_ABS, REG_Y>,
+    &CPUModel::op_load<REG_X, MODE_IMM>, &CPUModel::op_pop<REG_X>, &CPUModel::op_mul,
+    // 0xD0
+    &CPUModel::op_branch<FLAG_Z, false>, &CPUModel::op_tcall<13>, &CPUModel::op_set1<6, false>,
+    &CPUModel::op_bbs<6, false>, &CPUModel::op_store<MODE_DP_X, REG_A>, &CPUModel::op_store<MODE_ABS_X, REG_A>,
+    &CPUModel::op_store<MODE_ABS_Y, REG_A>, &CPUModel::op_store<MODE_IND_DP_Y, REG_A>,
+    &CPUModel::op_store<MODE_DP, REG_X>, &CPUModel::op_store<MODE_DP_Y, REG_X>, &CPUModel::op_movw_store,
+    &CPUModel::op_store<MODE_DP_X, REG_Y>, &CPUModel::op_rmw_reg<RMW_DEC, REG_Y>,
+    &CPUModel::op_transfer<REG_A, REG_Y>, &CPUModel::op_cbne<MODE_DP_X>, &CPUModel::op_daa,
+    // 0xE0
+    &CPUModel::op_clrv, &CPUModel::op_tcall<14>, &CPUModel::op_set1<7, true>, &CPUModel::op_bbs<7, true>,
+    &CPUModel::op_load<REG_A, MODE_DP>, &CPUModel::op_load<REG_A, MODE_ABS>, &CPUModel::op_load<REG_A, MODE_IND_X>,
+    &CPUModel::op_load<REG_A, MODE_IND_DP_X>, &CPUModel::op_load<REG_A, MODE_IMM>,
+    &CPUModel::op_load<REG_X, MODE_ABS>, &CPUModel::op_not1, &CPUModel::op_load<REG_Y, MODE_DP>,
+    &CPUModel::op_load<REG_Y, MODE_ABS>, &CPUModel::op_notc, &CPUModel::op_pop<REG_Y>, &CPUModel::op_halt,
+    // 0xF0
+    &CPUModel::op_branch<FLAG_Z, true>, &CPUModel::op_tcall<15>, &CPUModel::op_set1<7, false>,
+    &CPUModel::op_bbs<7, false>, &CPUModel::op_load<REG_A, MODE_DP_X>, &CPUModel::op_load<REG_A, MODE_ABS_X>,
+    &CPUModel::op_load<REG_A, MODE_ABS_Y>, &CPUModel::op_load<REG_A, MODE_IND_DP_Y>,
+    &CPUModel::op_load<REG_X, MODE_DP>, &CPUModel::op_load<REG_X, MODE_DP_Y>, &CPUModel::op_mov_dp_dp,
+    &CPUModel::op_load<REG_Y, MODE_DP_X>, &CPUModel::op_rmw_reg<RMW_INC, REG_Y>,
+    &CPUModel::op_transfer<REG_Y, REG_A>, &CPUModel::op_dbnz_y, &CPUModel::op_halt,
+};
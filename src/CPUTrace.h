@@ -0,0 +1,393 @@
+#pragma once
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "MappedFile.h"
+#include "SPC700.h"
+#include "types.h"
+
+// Binary instruction traces: one record per retired instruction, written by the CPU bench and read
+// back by tools/CPUTraceDump.cpp.
+//
+// A trace is a header followed by the records, either as fixed 16-byte CPUTraceRecords or delta
+// encoded. A delta record is a mask byte, the opcode, the fields the mask says have changed, then
+// the cycle delta as a LEB128 varint:
+//   mask bit 0     PC (2 bytes) when it isn't just past the previous instruction
+//   mask bits 1-5  A, X, Y, SP, PSW (a byte each) when they differ from the previous record
+// Straight-line code comes out at 3 or 4 bytes per instruction.
+
+struct CPUTraceRecord
+{
+  u64 cycle; // Bench tick the instruction retired on
+  u16 pc;    // Address of the instruction
+  u8 opcode;
+  u8 A, X, Y, SP;
+  u8 PSW; // Hardware layout, after the instruction
+};
+static_assert(sizeof(CPUTraceRecord) == 16);
+
+struct CPUTraceHeader
+{
+  char magic[8]; // "SPCTRACE"
+  u32 version;
+  u32 flags;
+  u64 records; // Kept up to date as each chunk of records is written
+};
+static_assert(sizeof(CPUTraceHeader) == 24);
+
+namespace CPUTrace
+{
+constexpr char Magic[8] = {'S', 'P', 'C', 'T', 'R', 'A', 'C', 'E'};
+constexpr u32 Version = 1;
+constexpr u32 FlagDelta = 1;
+
+enum DeltaMask : u8
+{
+  DELTA_PC = 0x01,
+  DELTA_A = 0x02,
+  DELTA_X = 0x04,
+  DELTA_Y = 0x08,
+  DELTA_SP = 0x10,
+  DELTA_PSW = 0x20,
+};
+
+constexpr u32 MaxDeltaBytes = 2 + 2 + 5 + 10;
+
+// Where the next instruction starts if the previous one didn't jump
+inline u16 fallthrough(const CPUTraceRecord &previous)
+{
+  return previous.pc + SPC700_OPCODES[previous.opcode].length;
+}
+} // namespace CPUTrace
+
+// Streams records to a file. Records are encoded into chunks that a background thread writes out,
+// so the simulation only waits if it gets several chunks ahead of the disk.
+class CPUTraceWriter
+{
+public:
+  static constexpr u32 ChunkBytes = 256 * 1024;
+  static constexpr u32 NumChunks = 4;
+
+  CPUTraceWriter() = default;
+  CPUTraceWriter(const CPUTraceWriter &) = delete;
+  CPUTraceWriter &operator=(const CPUTraceWriter &) = delete;
+
+  ~CPUTraceWriter() { close(); }
+
+  // Creates (or truncates) the file. Returns false if it can't be written.
+  bool open(const char *path, bool delta)
+  {
+    close();
+
+    m_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+      return false;
+
+    if (!m_chunks)
+      m_chunks.reset(new u8[NumChunks * ChunkBytes]);
+    m_delta = delta;
+    m_previous = {};
+    m_records = 0;
+    m_fill = 0;
+    m_queued = 0;
+    m_written = 0;
+    m_offset = sizeof(CPUTraceHeader);
+    m_closing = false;
+    m_failed = false;
+
+    // The record count is updated as chunks are written, so that a trace cut short by a crash
+    // still reads back up to its last whole chunk
+    if (!write_header(0))
+    {
+      ::close(m_fd);
+      m_fd = -1;
+      return false;
+    }
+
+    m_thread = std::thread([this] { write_chunks(); });
+    return true;
+  }
+
+  bool is_open() const { return m_fd >= 0; }
+
+  void push(const CPUTraceRecord &record)
+  {
+    if (m_fill + CPUTrace::MaxDeltaBytes > ChunkBytes)
+      queue_chunk();
+
+    u8 *out = chunk(m_queued) + m_fill;
+    if (m_delta)
+      m_fill += encode(record, out);
+    else
+    {
+      memcpy(out, &record, sizeof(record));
+      m_fill += sizeof(record);
+    }
+    m_previous = record;
+    m_records++;
+  }
+
+  u64 num_records() const { return m_records; }
+
+  // Writes what's left and the final header. Returns false if the file wasn't open, or any of it
+  // could not be written.
+  bool close()
+  {
+    if (m_fd < 0)
+      return false;
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closing = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+
+    bool ok = !m_failed;
+    ok = ok && write_at(chunk(m_queued), m_fill, m_offset);
+    ok = ok && write_header(m_records);
+    ok = (::close(m_fd) == 0) && ok;
+    m_fd = -1;
+    return ok;
+  }
+
+private:
+  u8 *chunk(u64 index) { return m_chunks.get() + (index % NumChunks) * ChunkBytes; }
+
+  u32 encode(const CPUTraceRecord &record, u8 *out) const
+  {
+    const CPUTraceRecord &previous = m_previous;
+    u8 *const start = out;
+    u8 &mask = *out++;
+    *out++ = record.opcode;
+
+    mask = 0;
+    if (m_records == 0 || record.pc != CPUTrace::fallthrough(previous))
+    {
+      mask |= CPUTrace::DELTA_PC;
+      *out++ = (u8)record.pc;
+      *out++ = (u8)(record.pc >> 8);
+    }
+#define DELTA_REGISTER(reg)                         \
+  if (m_records == 0 || record.reg != previous.reg) \
+  {                                                 \
+    mask |= CPUTrace::DELTA_##reg;                  \
+    *out++ = record.reg;                            \
+  }
+    DELTA_REGISTER(A)
+    DELTA_REGISTER(X)
+    DELTA_REGISTER(Y)
+    DELTA_REGISTER(SP)
+    DELTA_REGISTER(PSW)
+#undef DELTA_REGISTER
+
+    u64 cycles = record.cycle - previous.cycle;
+    do
+    {
+      *out++ = (u8)((cycles & 0x7F) | (cycles > 0x7F ? 0x80 : 0));
+      cycles >>= 7;
+    } while (cycles);
+    return out - start;
+  }
+
+  // Hands the full chunk to the writer thread, waiting for it if every chunk is still queued
+  void queue_chunk()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_sizes[m_queued % NumChunks] = m_fill;
+    m_chunk_records[m_queued % NumChunks] = m_records;
+    ++m_queued;
+    m_fill = 0;
+    m_cv.notify_all();
+    m_cv.wait(lock, [&] { return m_queued - m_written < NumChunks; });
+  }
+
+  // Writer thread: writes queued chunks in order until closed
+  void write_chunks()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+      m_cv.wait(lock, [&] { return m_written < m_queued || m_closing; });
+      if (m_written == m_queued)
+        return;
+
+      const u64 index = m_written;
+      const u32 size = m_sizes[index % NumChunks];
+      const u64 records = m_chunk_records[index % NumChunks];
+      lock.unlock();
+      bool ok = write_at(chunk(index), size, m_offset);
+      ok = ok && write_header(records);
+      m_offset += size;
+      lock.lock();
+
+      m_failed = m_failed || !ok;
+      ++m_written;
+      m_cv.notify_all();
+    }
+  }
+
+  bool write_at(const void *data, u64 size, u64 offset)
+  {
+    const u8 *bytes = (const u8 *)data;
+    while (size)
+    {
+      const ssize_t written = pwrite(m_fd, bytes, size, (off_t)offset);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0)
+        return false;
+      bytes += written;
+      size -= written;
+      offset += written;
+    }
+    return true;
+  }
+
+  // 'records' is how many records are in the file so far
+  bool write_header(u64 records)
+  {
+    CPUTraceHeader header;
+    memcpy(header.magic, CPUTrace::Magic, sizeof(header.magic));
+    header.version = CPUTrace::Version;
+    header.flags = m_delta ? CPUTrace::FlagDelta : 0;
+    header.records = records;
+    return write_at(&header, sizeof(header), 0);
+  }
+
+  int m_fd = -1;
+  std::unique_ptr<u8[]> m_chunks;
+  std::thread m_thread;
+
+  // Producer only
+  bool m_delta = false;
+  CPUTraceRecord m_previous = {};
+  u64 m_records = 0;
+  u32 m_fill = 0; // Bytes in the chunk being filled
+
+  // Chunks handed to the writer thread, and those it has written. Only the producer changes
+  // m_queued, and only the writer thread m_written and m_offset (until close() has joined it).
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  u32 m_sizes[NumChunks] = {};
+  u64 m_chunk_records[NumChunks] = {}; // Records written once the chunk is
+  u64 m_queued = 0;
+  u64 m_written = 0;
+  u64 m_offset = 0;
+  bool m_closing = false;
+  bool m_failed = false;
+};
+
+// Reads a trace back, record by record, from a memory mapping of the file
+class CPUTraceReader
+{
+public:
+  // Returns false with 'error' set if the file can't be read or isn't a trace
+  bool open(const char *path, const char **error)
+  {
+    if (!m_file.open(path))
+    {
+      *error = "could not be read";
+      return false;
+    }
+    if (m_file.size() < sizeof(CPUTraceHeader))
+    {
+      *error = "is too short for a trace";
+      return false;
+    }
+
+    memcpy(&m_header, m_file.data(), sizeof(m_header));
+    if (memcmp(m_header.magic, CPUTrace::Magic, sizeof(m_header.magic)) != 0 ||
+        m_header.version != CPUTrace::Version)
+    {
+      *error = "is not a version 1 CPU trace";
+      return false;
+    }
+
+    m_cursor = m_file.data() + sizeof(CPUTraceHeader);
+    m_read = 0;
+    m_record = {};
+    return true;
+  }
+
+  bool delta() const { return m_header.flags & CPUTrace::FlagDelta; }
+  u64 num_records() const { return m_header.records; }
+
+  // Decodes the next record. Returns false at the end, or if the rest of the file is truncated.
+  bool next(CPUTraceRecord *record)
+  {
+    const u8 *const end = m_file.data() + m_file.size();
+    if (m_read == m_header.records)
+      return false;
+
+    if (!delta())
+    {
+      if ((u64)(end - m_cursor) < sizeof(CPUTraceRecord))
+        return false;
+      memcpy(record, m_cursor, sizeof(CPUTraceRecord));
+      m_cursor += sizeof(CPUTraceRecord);
+      m_read++;
+      return true;
+    }
+
+    if (end - m_cursor < 3)
+      return false;
+    const u8 mask = *m_cursor++;
+    const u8 opcode = *m_cursor++;
+    unsigned fields = (mask & CPUTrace::DELTA_PC) ? 2 : 0;
+    for (u8 bit = CPUTrace::DELTA_A; bit <= CPUTrace::DELTA_PSW; bit <<= 1)
+      fields += (mask & bit) ? 1 : 0;
+    if (end - m_cursor < (ptrdiff_t)fields)
+      return false;
+
+    if (mask & CPUTrace::DELTA_PC)
+    {
+      m_record.pc = m_cursor[0] | (m_cursor[1] << 8);
+      m_cursor += 2;
+    }
+    else
+      m_record.pc = CPUTrace::fallthrough(m_record);
+    m_record.opcode = opcode;
+
+    const auto take = [&](u8 bit, u8 &field) {
+      if (mask & bit)
+        field = *m_cursor++;
+    };
+    take(CPUTrace::DELTA_A, m_record.A);
+    take(CPUTrace::DELTA_X, m_record.X);
+    take(CPUTrace::DELTA_Y, m_record.Y);
+    take(CPUTrace::DELTA_SP, m_record.SP);
+    take(CPUTrace::DELTA_PSW, m_record.PSW);
+
+    u64 cycles = 0;
+    for (unsigned shift = 0;; shift += 7)
+    {
+      if (m_cursor == end || shift > 63)
+        return false;
+      const u8 byte = *m_cursor++;
+      cycles |= (u64)(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        break;
+    }
+    m_record.cycle += cycles;
+
+    *record = m_record;
+    m_read++;
+    return true;
+  }
+
+private:
+  MappedFile m_file;
+  CPUTraceHeader m_header = {};
+  const u8 *m_cursor = nullptr;
+  u64 m_read = 0;
+  CPUTraceRecord m_record = {}; // Last decoded, for deltas
+};
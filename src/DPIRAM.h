@@ -0,0 +1,14 @@
+#pragma once
+
+#include "RAM.h"
+
+// The C side of the DPI-C RAM port in TestDSP.v, used by models verilated with -DDPI_RAM. The model
+// reads memory directly while it evaluates, so the bench no longer drives ram_data after every
+// clock. Reads come from the RAM bound with RAM::bind_dpi() on the simulating thread.
+//
+// This defines the imported function, so include it in exactly one translation unit of a program
+// linking a DPI_RAM model.
+extern "C" int dpi_ram_read(int address)
+{
+  return dpi_ram_data[address & 0xFFFF];
+}
@@ -110,7 +110,7 @@ output [15:0] __debug_voice_ram_address [7:0];
 ///////////////////////////////////////////////////////////////////////////////
 // DSP Registers
 
-reg [7:0] _regs   [127:0];           // ALL REGS!
+reg [7:0] _regs   [127:0] /* verilator public */; // ALL REGS!
 
 `ifdef DEBUG_DSP
 assign __debug_out_regs = _regs;
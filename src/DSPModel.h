@@ -0,0 +1,297 @@
+#pragma once
+
+#include "BRRBlockDecoder.h"
+#include "DSPVoiceDecoderModel.h"
+#include "types.h"
+
+// Native C++ model of DSP.v which is accurate to the output sample, not to the clock cycle.
+//
+// Instead of clocking the whole design 64 times per sample, the state machine of each voice decoder
+// is collapsed into one step per sample: the header reads, data reads and processing steps that
+// DSPVoiceDecoder.v would perform after an advance_trigger are counted exactly, while the sample
+// data itself is decoded a whole BRR block at a time, for all eight voices at once, by the SIMD
+// kernel in BRRBlockDecoder.h. The decoders' filter history is the sequence of decoded samples in
+// either case, so the output matches DSPVoiceDecoderModel sample for sample.
+//
+// The arithmetic is the same as DSP.v (ENVX/OUTX, VOLL/VOLR, MVOLL/MVOLR, pitch modulation), so the
+// audio matches the Verilog with three known simplifications:
+//  - The RAM port is always granted to the voice that needs it (no schedule contention).
+//  - Pitch modulation uses OUTX of the previous voice as of the end of the previous sample.
+//  - A block is read from RAM when its header is, rather than a byte at a time.
+class DSPModel
+{
+public:
+  static constexpr unsigned num_voices = 8;
+  static constexpr unsigned cycles_per_sample = 64;
+
+  // Register offsets, as in DSP.v
+  static constexpr u8 REG_VOLL = 0x00; // + voice * 0x10
+  static constexpr u8 REG_VOLR = 0x01;
+  static constexpr u8 REG_PL = 0x02;
+  static constexpr u8 REG_PH = 0x03;
+  static constexpr u8 REG_ENVX = 0x08;
+  static constexpr u8 REG_OUTX = 0x09;
+  static constexpr u8 REG_MVOLL = 0x0C;
+  static constexpr u8 REG_MVOLR = 0x1C;
+  static constexpr u8 REG_PMON = 0x2D;
+
+  // Snapshot of one voice decoder, using the state encoding of DSPVoiceDecoder.v
+  struct VoiceStatus
+  {
+    u8 state;
+    u16 ram_address;
+    u16 cursor;
+    s16 current_output;
+  };
+
+  DSPModel() { reset(); }
+
+  void reset()
+  {
+    for (unsigned v = 0; v < num_voices; ++v)
+    {
+      // As in the Verilog, decoders latch the pitch computed from the registers prior to reset.
+      m_lanes.state[v] = DSPVoiceDecoderModel::STATE_INIT;
+      m_lanes.cursor[v] = voice_pitch(v) + 4096;
+      m_lanes.block_address[v] = 0; // TODO : SRCN / DIR
+      m_lanes.header[v] = 0;
+      m_lanes.block_index[v] = 0;
+      m_lanes.unused_samples[v] = 0;
+      m_lanes.read_position[v] = 0;
+      m_lanes.previous_samples[0][v] = 0;
+      m_lanes.previous_samples[1][v] = 0;
+      m_decoder.reset(v);
+    }
+
+    for (unsigned i = 0; i < 128; ++i)
+      m_regs[i] = 0;
+    update_readonly_registers();
+
+    m_dac_out_l = 0;
+    m_dac_out_r = 0;
+    m_sample_count = 0;
+  }
+
+  void write_register(u8 index, u8 value) { m_regs[index & 0x7F] = value; }
+  u8 read_register(u8 index) const { return m_regs[index & 0x7F]; }
+  const u8 *registers() const { return m_regs; }
+
+  VoiceStatus voice(unsigned v) const
+  {
+    VoiceStatus status;
+    status.state = m_lanes.state[v];
+    status.ram_address = m_lanes.block_address[v] + m_lanes.block_index[v];
+    status.cursor = m_lanes.cursor[v];
+    status.current_output = m_lanes.current_output[v];
+    return status;
+  }
+
+  s16 dac_out_l() const { return m_dac_out_l; }
+  s16 dac_out_r() const { return m_dac_out_r; }
+  u64 sample_count() const { return m_sample_count; }
+
+  // Produces the next stereo output sample, reading sample data from the 64 KiB 'ram'.
+  void render_sample(const u8 *ram)
+  {
+    // Advance every decoder, gathering the blocks whose headers were read
+    m_decode_mask = 0;
+    for (unsigned v = 0; v < num_voices; ++v)
+      trigger_voice(v, voice_pitch(v), ram);
+
+    if (m_decode_mask)
+    {
+      BRRBlockSamples samples;
+      brr_decode_blocks(m_blocks, m_decode_mask, m_decoder, samples);
+      for (unsigned v = 0; v < num_voices; ++v)
+      {
+        if (!(m_decode_mask & (1 << v)))
+          continue;
+        // The header is read once all 16 samples of the previous block have been, so a new block
+        // always starts a half of the ring.
+        const u8 position = m_lanes.block_position[v];
+        for (unsigned i = 0; i < BRR_BLOCK_SAMPLES; ++i)
+          m_lanes.decoded[v][position + i] = samples[i][v];
+      }
+    }
+
+    for (unsigned v = 0; v < num_voices; ++v)
+      process_voice(v);
+
+    s32 mix[num_voices];
+    s32 dac_l = 0;
+    s32 dac_r = 0;
+    for (unsigned v = 0; v < num_voices; ++v)
+    {
+      const u8 base = v << 4;
+      mix[v] = ((s32)m_lanes.current_output[v] * (s8)m_regs[base | REG_ENVX]) >> 7;
+      dac_l += mix[v] * (s8)m_regs[base | REG_VOLL];
+      dac_r += mix[v] * (s8)m_regs[base | REG_VOLR];
+    }
+    dac_l = ((dac_l >> 7) * (s8)m_regs[REG_MVOLL]) >> 7;
+    dac_r = ((dac_r >> 7) * (s8)m_regs[REG_MVOLR]) >> 7;
+
+    m_dac_out_l = (s16)(u16)dac_l;
+    m_dac_out_r = (s16)(u16)dac_r;
+
+    for (unsigned v = 0; v < num_voices; ++v)
+      m_regs[(v << 4) | REG_OUTX] = (u8)mix[v];
+    update_readonly_registers();
+
+    m_sample_count++;
+  }
+
+  // Renders 'num_frames' interleaved L/R frames into 'out'.
+  void render(const u8 *ram, s16 *out, u32 num_frames)
+  {
+    for (u32 i = 0; i < num_frames; ++i)
+    {
+      render_sample(ram);
+      *out++ = m_dac_out_l;
+      *out++ = m_dac_out_r;
+    }
+  }
+
+private:
+  static constexpr unsigned ring_size = 2 * BRR_BLOCK_SAMPLES;
+
+  // Decoder state for all voices, one array entry per voice
+  struct VoiceLanes
+  {
+    u8 state[num_voices];
+    u16 cursor[num_voices];
+    u16 block_address[num_voices]; // Address of the current block's header
+    u8 header[num_voices];
+    u8 block_index[num_voices];    // Data bytes read from the current block
+    u8 unused_samples[num_voices]; // Samples read but not yet processed
+    u8 read_position[num_voices];  // Ring position of the next sample to be read
+    u8 block_position[num_voices]; // Ring position of the current block's first sample
+    s16 previous_samples[2][num_voices];
+    s16 current_output[num_voices] = {};
+    s16 decoded[num_voices][ring_size]; // The current and next decoded blocks
+  };
+
+  u8 m_regs[128] = {};
+  VoiceLanes m_lanes;
+  BRRDecoderLanes m_decoder;
+  BRRBlockData m_blocks = {}; // Blocks to decode this sample, selected by m_decode_mask
+  u8 m_decode_mask;
+  s16 m_dac_out_l;
+  s16 m_dac_out_r;
+  u64 m_sample_count;
+
+  void update_readonly_registers()
+  {
+    // TODO : proper envelope generation. DSP.v holds ENVX at full scale.
+    for (unsigned v = 0; v < num_voices; ++v)
+      m_regs[(v << 4) | REG_ENVX] = 0x7F;
+  }
+
+  // Pitch from PL/PH, plus pitch modulation by the previous voice computed as written in DSP.v:
+  // P' = (P + P * OUTX[v-1]) >> 7, saturated to 14 bits.
+  u16 voice_pitch(unsigned v) const
+  {
+    const u8 base = v << 4;
+    u32 pitch = ((m_regs[base | REG_PH] & 0x3F) << 8) | m_regs[base | REG_PL];
+    if (v > 0 && (m_regs[REG_PMON] & (1 << v)))
+    {
+      pitch = (pitch + pitch * m_regs[((v - 1) << 4) | REG_OUTX]) >> 7;
+      if (pitch > 0x3FFF)
+        pitch = 0x3FFF;
+    }
+    return pitch & 0x3FFF;
+  }
+
+  // STATE_READ_HEADER: queues the block at 'address' to be decoded.
+  void read_header(unsigned v, u16 address, const u8 *ram)
+  {
+    for (unsigned i = 0; i < BRR_BLOCK_BYTES; ++i)
+      m_blocks[v][i] = ram[(u16)(address + i)];
+    m_decode_mask |= 1 << v;
+    m_lanes.header[v] = m_blocks[v][0];
+    m_lanes.block_address[v] = address;
+    m_lanes.block_index[v] = 0;
+    m_lanes.block_position[v] = m_lanes.read_position[v];
+  }
+
+  // STATE_READ_DATA, repeated until at least two samples were available before the last read.
+  // Returns false if the voice ended instead.
+  bool read_data(unsigned v, const u8 *ram)
+  {
+    for (;;)
+    {
+      const u8 old_unused_samples = m_lanes.unused_samples[v];
+      const u8 old_block_index = m_lanes.block_index[v];
+      m_lanes.unused_samples[v] += 2;
+      m_lanes.read_position[v] = (m_lanes.read_position[v] + 2) % ring_size;
+      m_lanes.block_index[v]++;
+
+      if (old_unused_samples >= 2)
+        return true;
+      if (old_block_index == 7 && !next_block(v, ram))
+        return false;
+    }
+  }
+
+  // Moves on from a fully read block, following the header's end/loop flags. Returns false if the
+  // voice ended.
+  bool next_block(unsigned v, const u8 *ram)
+  {
+    const u8 header = m_lanes.header[v];
+    const bool header_end = header & 1;
+    const bool header_loop = header & 2;
+    if (header_end && !header_loop)
+    {
+      m_lanes.state[v] = DSPVoiceDecoderModel::STATE_END;
+      return false;
+    }
+    const u16 loop_address = 0; // TODO : SRCN / DIR
+    read_header(v, header_end ? loop_address : (u16)(m_lanes.block_address[v] + BRR_BLOCK_BYTES), ram);
+    return true;
+  }
+
+  // Applies an advance_trigger to voice 'v', performing all of the header and data reads that
+  // follow it.
+  void trigger_voice(unsigned v, u16 pitch, const u8 *ram)
+  {
+    switch (m_lanes.state[v])
+    {
+    case DSPVoiceDecoderModel::STATE_INIT:
+      m_lanes.state[v] = DSPVoiceDecoderModel::STATE_OUTPUT_AND_WAIT;
+      read_header(v, 0, ram); // TODO : SRCN / DIR
+      read_data(v, ram);
+      break;
+
+    case DSPVoiceDecoderModel::STATE_OUTPUT_AND_WAIT:
+      // Processing leaves the cursor below 4096, so this never wraps.
+      m_lanes.cursor[v] += pitch;
+      if (m_lanes.unused_samples[v] >= 4)
+        break;
+      if (m_lanes.block_index[v] == 8 && !next_block(v, ram))
+        break;
+      read_data(v, ram);
+      break;
+    }
+  }
+
+  // STATE_PROCESS_SAMPLE for every whole sample the cursor has passed, then STATE_OUTPUT_AND_WAIT
+  // latching the interpolated output.
+  void process_voice(unsigned v)
+  {
+    if (m_lanes.state[v] != DSPVoiceDecoderModel::STATE_OUTPUT_AND_WAIT)
+      return;
+
+    while (m_lanes.cursor[v] >= 4096)
+    {
+      const u8 position = (m_lanes.read_position[v] - m_lanes.unused_samples[v]) & (ring_size - 1);
+      m_lanes.previous_samples[1][v] = m_lanes.previous_samples[0][v];
+      m_lanes.previous_samples[0][v] = m_lanes.decoded[v][position];
+      m_lanes.unused_samples[v]--;
+      m_lanes.cursor[v] -= 4096;
+    }
+
+    const s32 fraction = m_lanes.cursor[v] & 0xFFF;
+    s32 result = m_lanes.previous_samples[0][v] * fraction;
+    result += m_lanes.previous_samples[1][v] * (4096 - fraction);
+    m_lanes.current_output[v] = (s16)(u16)(result >> 12);
+  }
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cassert>
+#include <vector>
+
+#include "RAM.h"
+#include "types.h"
+#include "wave.h"
+
+// Render loops shared by the DSP benches and tools. They are templated on the bench so that the
+// same loop can drive a verilated model or a native one.
+
+const unsigned DSP_CYCLES_PER_SAMPLE = 64;
+const unsigned DSP_CYCLES_PER_SEC = DSP_AUDIO_RATE * DSP_CYCLES_PER_SAMPLE;
+
+////////////////////////////////////////////////////////////////////////////////
+// Full DSP (TestDSP)
+////////////////////////////////////////////////////////////////////////////////
+
+// Plays a C major chord (C E G C) on the first voices, sampling from address 0.
+template <class Bench>
+void dsp_write_test_registers(Bench &bench)
+{
+  // f * 2**(n / 12)
+  const unsigned pitch[] = {4096, 5161, 6137, 8192, 2048, 1024, 512, 256};
+  const unsigned MAXVOL = 0xEF;
+  const unsigned Q = MAXVOL / 8;
+  const unsigned vol[] = {Q, Q, Q, 0, 0, 0, 0, 0};
+
+  for (int v = 0; v < 8; v++)
+  {
+    const unsigned vpitch = pitch[v] * 1 / 8;
+
+    // Pitch low (x2)
+    bench->dsp_reg_address = (v << 4) | 2;
+    bench->dsp_reg_data_in = vpitch & 0xFF;
+    bench->dsp_reg_write_enable = 1;
+    bench.tick();
+
+    // Pitch high (x3)
+    bench->dsp_reg_address = (v << 4) | 3;
+    bench->dsp_reg_data_in = (vpitch >> 8) & 0xFF;
+    bench->dsp_reg_write_enable = 1;
+    bench.tick();
+
+    // Volume Left (x0)
+    bench->dsp_reg_address = (v << 4) | 0;
+    bench->dsp_reg_data_in = vol[v];
+    bench->dsp_reg_write_enable = 1;
+    bench.tick();
+
+    // Volume Right (x1)
+    bench->dsp_reg_address = (v << 4) | 1;
+    bench->dsp_reg_data_in = vol[v];
+    bench->dsp_reg_write_enable = 1;
+    bench.tick();
+  }
+
+  bench->dsp_reg_write_enable = 0;
+}
+
+// Clocks the DSP for 'num_samples' output samples, serving its RAM reads from 'ram'. The recorder
+// is a WaveRecorder, or a WaveWriter to stream long renders to disk.
+template <class Bench, class Recorder>
+void dsp_render(Bench &bench, const RAM &ram, unsigned num_samples, Recorder &recorder)
+{
+  ram.bind_dpi();
+  bench.attach_ram(ram.raw());
+  bench.run((u64)DSP_CYCLES_PER_SAMPLE * num_samples, [&](s16 left, s16 right)
+            { recorder.push(left, right); });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Single voice decoder (DSPVoiceDecoder)
+////////////////////////////////////////////////////////////////////////////////
+
+const int MAX_VOICE_TEST_CYCLES = 500000;
+const unsigned MAX_VOICE_TEST_SAMPLES = 32000 * 5;
+
+template <class Bench>
+void voice_setup(Bench &bench)
+{
+  const auto voice = bench.get();
+  voice->pitch = 4095 / 4;
+  voice->start_address = 0;
+  // TODO: Loop point is not properly set, so loop will happen at the beginning
+
+  bench.reset();
+}
+
+// Runs one clock of the voice test. Returns false once the voice has reached its end state. When
+// an output sample is produced, it is written to 'sample' and 'sample_ready' is set.
+template <class Bench>
+bool voice_cycle(Bench &bench, const RAM &ram, int i, s16 *sample, bool *sample_ready)
+{
+  const auto voice = bench.get();
+  const s16 output = voice->current_output;
+
+  *sample_ready = false;
+  if (voice->state == 5)
+    return false;
+
+  if (i == 0)
+    voice->advance_trigger = 1;
+  if (i == 1)
+    voice->advance_trigger = 0;
+
+  voice->ram_data = ram.get(voice->ram_address);
+  bench.tick();
+
+  // When we're in the OUTPUT_AND_WAIT state, we need to trigger a pulse in advance_trigger to get our next sample.
+  if (!voice->advance_trigger && voice->state == 4)
+  {
+    voice->advance_trigger = 1;
+    *sample = output;
+    *sample_ready = true;
+  }
+  else if (voice->advance_trigger)
+  {
+    voice->advance_trigger = 0;
+  }
+  return true;
+}
+
+// Runs the voice test until the voice ends or the sample/cycle limits are reached.
+template <class Bench, class Recorder>
+void voice_render(Bench &bench, const RAM &ram, Recorder &recorder)
+{
+  voice_setup(bench);
+
+  unsigned samples = 0;
+  for (int i = 0; i < MAX_VOICE_TEST_CYCLES && samples < MAX_VOICE_TEST_SAMPLES; ++i)
+  {
+    s16 sample;
+    bool sample_ready;
+    if (!voice_cycle(bench, ram, i, &sample, &sample_ready))
+      break;
+
+    if (sample_ready)
+    {
+      recorder.push(sample, sample);
+      samples++;
+    }
+  }
+}
@@ -1,8 +1,13 @@
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <array>
 
 #include "BasicBench.h"
+#include "DSPRender.h"
+#include "DSPVoiceDecoderModel.h"
+#include "RAM.h"
 #include "VDSPVoiceDecoder.h"
 #include "VDSPVoiceDecoder_DSPVoiceDecoder.h"
 #include "types.h"
@@ -10,27 +15,11 @@
 
 double global_time = 0;
 
-class RAM
+class DSPVoiceBench : public BasicBench<VDSPVoiceDecoder>
 {
-private:
-  std::array<u8, 64 * 1024> data;
-
-public:
-  void put(u16 addr, u8 val) { data[addr] = val; }
-  u8 get(u16 addr) { return data[addr]; }
-
-  void load(const char *path)
-  {
-    auto file = fopen(path, "rb");
-    fseek(file, 0, SEEK_END);
-    const u64 file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    fread(&data[0], sizeof(u8), file_size, file);
-    fclose(file);
-  }
 };
 
-class DSPVoiceBench : public BasicBench<VDSPVoiceDecoder>
+class DSPVoiceModelBench : public BasicBench<DSPVoiceDecoderModel>
 {
 };
 
@@ -43,54 +32,93 @@ static const char *const STATE_NAMES[] = {
     "END",
 };
 
-void dsp_test_wave_out(DSPVoiceBench &bench, const char *brr_path)
+unsigned block_index(const VDSPVoiceDecoder *voice) { return voice->DSPVoiceDecoder->block_index; }
+unsigned block_index(const DSPVoiceDecoderModel *voice) { return voice->block_index; }
+
+template <class Bench>
+void dsp_test_wave_out(Bench &bench, const char *brr_path)
 {
   RAM ram;
   ram.load(brr_path);
 
-  const auto voice = bench.get();
-  voice->pitch = 4095 / 4;
-  voice->start_address = 0;
-  // TODO: Loop point is not properly set, so loop will happen at the beginning
+  WaveWriter recorder;
+  if (!recorder.open("./build/dsp_voice_test_wave_out.wav"))
+  {
+    printf("Could not write ./build/dsp_voice_test_wave_out.wav\n");
+    return;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  voice_render(bench, ram, recorder);
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  if (!recorder.close())
+    printf("Failed to write the whole render\n");
+  printf("Simulated %llu ticks (%.0f ticks/sec)\n", bench.time(), bench.time() / elapsed.count());
+}
 
-  bench.reset();
-  WaveRecorder recorder;
+// Compares every output port of the verilated decoder against the native model. Returns true if
+// they match, printing the mismatching ports otherwise.
+bool compare_voices(const VDSPVoiceDecoder *rtl, const DSPVoiceDecoderModel *model)
+{
+  bool match = true;
+#define COMPARE_PORT(port)                                                           \
+  if (rtl->port != model->port)                                                      \
+  {                                                                                  \
+    printf("  %-16s verilator:%6u native:%6u\n", #port, rtl->port, model->port); \
+    match = false;                                                                   \
+  }
+  COMPARE_PORT(state)
+  COMPARE_PORT(ram_address)
+  COMPARE_PORT(ram_read_request)
+  COMPARE_PORT(current_output)
+  COMPARE_PORT(reached_end)
+  COMPARE_PORT(cursor)
+#undef COMPARE_PORT
+  return match;
+}
+
+// Runs the verilated decoder and the native model side by side, stopping at the first cycle
+// where any of their outputs differ. Returns the number of divergent cycles found (0 or 1).
+int dsp_lockstep_test(DSPVoiceBench &rtl_bench, DSPVoiceModelBench &model_bench, const char *brr_path)
+{
+  RAM ram;
+  ram.load(brr_path);
+
+  voice_setup(rtl_bench);
+  voice_setup(model_bench);
+
+  if (!compare_voices(rtl_bench.get(), model_bench.get()))
+  {
+    printf("Diverged after reset\n");
+    return 1;
+  }
 
   unsigned samples = 0;
-  for (int i = 0; i < 500000 && samples < 32000 * 5; ++i)
+  for (int i = 0; i < MAX_VOICE_TEST_CYCLES && samples < MAX_VOICE_TEST_SAMPLES; ++i)
   {
-    const int read_requested = voice->ram_read_request & 1;
-    const int state = voice->state;
-    const s16 output = voice->current_output;
-    const unsigned cursor = voice->cursor;
-    const unsigned block_index = voice->DSPVoiceDecoder->block_index;
-    // printf("[%06u] state:%8s read:%d cursor:%8u block_index:%u output:%d\n", i, STATE_NAMES[state], read_requested, cursor, block_index, output);
-
-    if (voice->state == 5)
-      break;
+    s16 rtl_sample, model_sample;
+    bool rtl_ready, model_ready;
+    const bool rtl_running = voice_cycle(rtl_bench, ram, i, &rtl_sample, &rtl_ready);
+    const bool model_running = voice_cycle(model_bench, ram, i, &model_sample, &model_ready);
 
-    if(i==0)
-      voice->advance_trigger = 1;
-    if(i==1)
-      voice->advance_trigger = 0;
+    if (!compare_voices(rtl_bench.get(), model_bench.get()))
+    {
+      const auto voice = rtl_bench.get();
+      printf("Diverged at cycle %d (tick %llu, verilator state %s, block_index %u)\n",
+             i, rtl_bench.time(), STATE_NAMES[voice->state], block_index(voice));
+      return 1;
+    }
 
-    voice->ram_data = ram.get(voice->ram_address);
-    bench.tick();
+    if (!rtl_running || !model_running)
+      break;
 
-    // When we're in the OUTPUT_AND_WAIT state, we need to trigger a pulse in advance_trigger to get our next sample.
-    if (!voice->advance_trigger && voice->state == 4)
-    {
-      voice->advance_trigger = 1;
-      recorder.push(output, output);
+    if (rtl_ready)
       samples++;
-    }
-    else if (voice->advance_trigger)
-    {
-      voice->advance_trigger = 0;
-    }
   }
-  recorder.save("./build/dsp_voice_test_wave_out.wav");
-  printf("Simulated %llu ticks\n", bench.time());
+
+  printf("Lockstep OK: %llu ticks, %u samples\n", rtl_bench.time(), samples);
+  return 0;
 }
 
 double sc_time_stamp()
@@ -102,13 +130,42 @@ int main(int argc, char **argv, char **env)
 {
   Verilated::commandArgs(argc, argv);
 
-  if (argc < 2)
+  const char *backend = "verilator";
+  const char *brr_path = nullptr;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strncmp(argv[i], "--backend=", 10))
+      backend = argv[i] + 10;
+    else if (argv[i][0] != '+')
+      brr_path = argv[i];
+  }
+
+  if (!brr_path)
   {
-    printf("Usage: %s brr_file_path\n", argv[0]);
+    printf("Usage: %s [--backend=verilator|native|lockstep] brr_file_path\n", argv[0]);
     exit(1);
   }
 
-  DSPVoiceBench bench;
-  dsp_test_wave_out(bench, argv[1]);
+  if (!strcmp(backend, "verilator"))
+  {
+    DSPVoiceBench bench;
+    dsp_test_wave_out(bench, brr_path);
+  }
+  else if (!strcmp(backend, "native"))
+  {
+    DSPVoiceModelBench bench;
+    dsp_test_wave_out(bench, brr_path);
+  }
+  else if (!strcmp(backend, "lockstep"))
+  {
+    DSPVoiceBench rtl_bench;
+    DSPVoiceModelBench model_bench;
+    return dsp_lockstep_test(rtl_bench, model_bench, brr_path);
+  }
+  else
+  {
+    printf("Unknown backend '%s'\n", backend);
+    exit(1);
+  }
   return 0;
 }
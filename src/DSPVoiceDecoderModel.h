@@ -0,0 +1,244 @@
+#pragma once
+
+#include "types.h"
+
+// Native C++ model of DSPVoiceDecoder.v, accurate to the clock cycle.
+//
+// Port names and widths mirror the verilated VDSPVoiceDecoder so that the same
+// bench code (e.g. BasicBench<DSPVoiceDecoderModel>) can drive either one. As
+// with a verilated model, inputs are set directly and eval() is called; the
+// clocked block runs on a rising edge of 'clock', with every right-hand side
+// sampled before any register is written (non-blocking assignment semantics).
+class DSPVoiceDecoderModel
+{
+public:
+  enum State
+  {
+    STATE_INIT = 0,
+    STATE_READ_HEADER = 1,
+    STATE_READ_DATA = 2,
+    STATE_PROCESS_SAMPLE = 3,
+    STATE_OUTPUT_AND_WAIT = 4,
+    STATE_END = 5,
+  };
+
+  // Inputs
+  u8 clock = 0;
+  u8 reset = 0;
+  u8 ram_data = 0;
+  u16 start_address = 0;
+  u16 loop_address = 0;
+  u16 pitch = 0; // 14 bits
+  u8 advance_trigger = 0;
+
+  // Outputs
+  u8 state = STATE_INIT;
+  u16 ram_address = 0;
+  u8 ram_read_request = 0;
+  u16 current_output = 0; // s16 bit pattern, as Verilator exposes it
+  u8 reached_end = 0;
+  u16 cursor = 0;
+
+  // Internal state. Exposed like 'verilator public' signals for debugging.
+  u8 cursor_i = 0;          // 3 bits
+  u8 unused_samples = 0;    // 3 bits
+  s16 read_buffer[8] = {};  // Ring buffer of decompressed samples
+  u8 filter_buffer[8] = {}; // ADPCM filter for each read_buffer entry
+  u8 read_buffer_index = 0; // 3 bits
+  u8 block_index = 0;       // 4 bits
+  s16 previous_samples[4] = {};
+  u8 header = 0;
+
+  void eval()
+  {
+    if (clock && !m_last_clock)
+      posedge();
+    m_last_clock = clock;
+  }
+
+  void final() {}
+
+  // Combinational 'filter_out': the ADPCM filtered value of the sample under cursor_i.
+  s16 filter_out() const
+  {
+    const s32 sample = read_buffer[cursor_i];
+    const s32 p0 = previous_samples[0];
+    const s32 p1 = previous_samples[1];
+
+    // Verilog signed division truncates toward zero, as does C++.
+    s32 result = sample;
+    switch (filter_buffer[cursor_i])
+    {
+    case 1:
+      result = sample + p0 * 15 / 16;
+      break;
+    case 2:
+      result = sample + p0 * 61 / 32 + p1 * -15 / 16;
+      break;
+    case 3:
+      result = sample + p0 * 115 / 64 + p1 * -13 / 16;
+      break;
+    }
+    return (s16)(u16)result;
+  }
+
+  // Combinational 'current_output_x': linear interpolation between the two most recent samples.
+  s16 interpolated_output() const
+  {
+    const s32 fraction = cursor & 0xFFF;
+    s32 result = previous_samples[0] * fraction;
+    result += previous_samples[1] * (4096 - fraction);
+    return (s16)(u16)(result >> 12);
+  }
+
+private:
+  u8 m_last_clock = 0;
+
+  static u16 expand_nibble(u8 nibble, u8 range)
+  {
+    // { {12{nibble[3]}}, nibble } << range, truncated to 16 bits
+    const s32 extended = (nibble & 0x8) ? (s32)nibble - 16 : (s32)nibble;
+    return (u16)((u32)extended << range);
+  }
+
+  void posedge()
+  {
+    if (reset)
+    {
+      cursor_i = 0;
+      cursor = (u16)((pitch & 0x3FFF) + 4096);
+      state = STATE_INIT;
+      header = 0;
+
+      for (unsigned i = 0; i < 8; ++i)
+      {
+        read_buffer[i] = 0;
+        filter_buffer[i] = 0;
+      }
+
+      read_buffer_index = 0;
+      block_index = 0;
+
+      previous_samples[0] = 0;
+      previous_samples[1] = 0;
+
+      unused_samples = 0;
+
+      ram_address = start_address;
+      return;
+    }
+
+    // The BRR header flags decide what happens at the end of a block.
+    const bool header_end = header & 1;
+    const bool header_loop = header & 2;
+    const bool final_block_do_end = header_end && !header_loop;
+    const bool final_block_do_loop = header_end && header_loop;
+
+    switch (state)
+    {
+    case STATE_INIT:
+      if (advance_trigger)
+      {
+        ram_address = start_address;
+        ram_read_request = 1;
+        state = STATE_READ_HEADER;
+        reached_end = 0;
+      }
+      break;
+
+    case STATE_READ_HEADER:
+      header = ram_data;
+      state = STATE_READ_DATA;
+      ram_address = ram_address + 1;
+      ram_read_request = 1;
+      block_index = 0;
+      break;
+
+    case STATE_READ_DATA:
+    {
+      const u8 rbi0 = read_buffer_index;
+      const u8 rbi1 = (read_buffer_index + 1) & 7;
+      const u8 range = header >> 4;
+      const u8 filter = (header >> 2) & 3;
+      const u8 old_unused_samples = unused_samples;
+      const u8 old_block_index = block_index;
+
+      read_buffer[rbi0] = (s16)expand_nibble(ram_data >> 4, range);
+      read_buffer[rbi1] = (s16)expand_nibble(ram_data & 0xF, range);
+      filter_buffer[rbi0] = filter;
+      filter_buffer[rbi1] = filter;
+
+      read_buffer_index = (read_buffer_index + 2) & 7;
+      unused_samples = (unused_samples + 2) & 7;
+      block_index = (block_index + 1) & 15;
+
+      if (old_unused_samples >= 2)
+      {
+        state = (cursor >= 4096) ? STATE_PROCESS_SAMPLE : STATE_OUTPUT_AND_WAIT;
+        ram_read_request = 0;
+      }
+      else if (old_block_index == 7)
+      {
+        state = final_block_do_end ? STATE_END : STATE_READ_HEADER;
+        ram_address = final_block_do_loop ? loop_address : (u16)(ram_address + 1);
+        ram_read_request = !final_block_do_end;
+      }
+      else
+      {
+        state = STATE_READ_DATA;
+        ram_address = ram_address + 1;
+        ram_read_request = 1;
+      }
+      break;
+    }
+
+    case STATE_PROCESS_SAMPLE:
+    {
+      const u16 old_cursor = cursor;
+      const s16 new_sample = filter_out();
+      previous_samples[3] = previous_samples[2];
+      previous_samples[2] = previous_samples[1];
+      previous_samples[1] = previous_samples[0];
+      previous_samples[0] = new_sample;
+      cursor = old_cursor - 4096;
+      cursor_i = (cursor_i + 1) & 7;
+      unused_samples = (unused_samples - 1) & 7;
+
+      state = (old_cursor >= 4096 * 2) ? STATE_PROCESS_SAMPLE : STATE_OUTPUT_AND_WAIT;
+      break;
+    }
+
+    case STATE_OUTPUT_AND_WAIT:
+      current_output = (u16)interpolated_output();
+
+      if (advance_trigger)
+      {
+        // The comparison happens in 32-bit context in the Verilog, so it never wraps.
+        const u32 next_cursor = (u32)cursor + (pitch & 0x3FFF);
+        cursor = (u16)next_cursor;
+
+        if (unused_samples >= 4)
+        {
+          state = (next_cursor >= 4096) ? STATE_PROCESS_SAMPLE : STATE_OUTPUT_AND_WAIT;
+        }
+        else if (block_index == 8)
+        {
+          state = final_block_do_end ? STATE_END : STATE_READ_HEADER;
+          ram_address = final_block_do_loop ? loop_address : (u16)(ram_address + 1);
+          ram_read_request = !final_block_do_end;
+        }
+        else
+        {
+          state = STATE_READ_DATA;
+          ram_address = ram_address + 1;
+          ram_read_request = 1;
+        }
+      }
+      break;
+
+    case STATE_END:
+      reached_end = 1;
+      break;
+    }
+  }
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "types.h"
+
+// A whole file mapped read-only into memory. Loaders read straight out of the mapping, so nothing
+// is allocated or copied until the data reaches its destination (e.g. RAM).
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() { close(); }
+
+  // Returns false if the file could not be opened or mapped. Empty files map to no data.
+  bool open(const char *path)
+  {
+    close();
+
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    m_size = (u64)st.st_size;
+    if (m_size)
+    {
+      void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED)
+      {
+        ::close(fd);
+        m_size = 0;
+        return false;
+      }
+      m_data = (const u8 *)mapping;
+    }
+
+    // The mapping stays valid without the descriptor
+    ::close(fd);
+    return true;
+  }
+
+  void close()
+  {
+    if (m_data)
+      munmap((void *)m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+  }
+
+  const u8 *data() const { return m_data; }
+  u64 size() const { return m_size; }
+
+private:
+  const u8 *m_data = nullptr;
+  u64 m_size = 0;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+#include "APUFiles.h"
+#include "types.h"
+
+// 64 KiB of APU RAM, as seen by the benches, tools and GUI.
+class RAM
+{
+private:
+  std::array<u8, 64 * 1024> data = {};
+
+public:
+  static constexpr u32 size() { return 64 * 1024; }
+
+  void put(u16 addr, u8 val) { data[addr] = val; }
+  void put(u16 addr, u32 length, const u8 *source)
+  {
+    memcpy(&data[addr], source, length);
+  }
+  u8 get(u16 addr) const { return data[addr]; }
+  void get(u16 addr, u32 length, u8 *dest) const
+  {
+    memcpy(dest, &data[addr], length);
+  }
+
+  u8 *raw() { return data.data(); }
+  const u8 *raw() const { return data.data(); }
+
+  // Loads a file to the start of RAM, straight from the mapped file. Anything past 64 KiB is ignored.
+  // Returns false if the file could not be opened or is empty.
+  bool load(const char *path)
+  {
+    MappedFile file;
+    if (!file.open(path) || !file.size())
+      return false;
+    put(0, (u32)std::min<u64>(file.size(), size()), file.data());
+    return true;
+  }
+
+  // Loads a BRR sample to the start of RAM
+  void load(const BRRFile &brr) { put(0, brr.size(), brr.data()); }
+
+  // Loads the RAM image of an SPC file
+  void load(const SPCFile &spc) { put(0, size(), spc.ram()); }
+
+  // Makes this RAM the one read by models verilated with DPI_RAM (see DPIRAM.h) on the calling
+  // thread.
+  void bind_dpi() const;
+};
+
+// RAM read by DPI_RAM models. Per thread, so that each simulation thread can have its own.
+inline thread_local const u8 *dpi_ram_data = nullptr;
+
+inline void RAM::bind_dpi() const { dpi_ram_data = data.data(); }
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstdio>
+#include <string_view>
+
+#include "types.h"
+
+// The SPC700 instruction set as a single table, indexed by opcode. The assembler, the disassembler,
+// the reference interpreter's cycle counts and the fuzzer's instruction lengths all come from it.
+//
+// Operands are written as in the usual SPC700 syntax, with lowercase placeholders for the encoded
+// fields:
+//   d    direct page byte                  #i   immediate byte
+//   !a   absolute word                     r    branch offset (a target address in text)
+//   m.b  13-bit address and bit number     u    PCALL's offset into page $FF
+// Everything else (registers, brackets, TCALL and SET1 numbers) is literal. Fields are encoded
+// source first, so the two bytes of "d, #i" and "d, d" come out in reverse order, but a branch
+// offset always comes last.
+struct SPC700Opcode
+{
+  const char *mnemonic;
+  const char *operands;
+  u8 length; // Bytes, opcode included. Derived from the operands.
+  u8 cycles; // Without the 2 extra cycles of a taken branch, which BRA always is
+
+  constexpr SPC700Opcode(const char *mnemonic, const char *operands, u8 cycles)
+      : mnemonic(mnemonic), operands(operands), length(1 + field_bytes(operands)), cycles(cycles)
+  {
+  }
+
+  static constexpr bool is_field(char c)
+  {
+    return c == 'd' || c == 'i' || c == 'a' || c == 'r' || c == 'm' || c == 'b' || c == 'u';
+  }
+
+  // Encoded size of a field. The bit number of m.b shares m's word.
+  static constexpr unsigned field_size(char c) { return (c == 'a' || c == 'm') ? 2 : (c == 'b') ? 0 : 1; }
+
+  static constexpr unsigned field_bytes(const char *operands)
+  {
+    unsigned bytes = 0;
+    for (; *operands; ++operands)
+      bytes += is_field(*operands) ? field_size(*operands) : 0;
+    return bytes;
+  }
+};
+
+inline constexpr SPC700Opcode SPC700_OPCODES[256] = {
+    // 0x00
+    {"NOP", "", 2}, {"TCALL", "0", 8}, {"SET1", "d.0", 4}, {"BBS", "d.0, r", 5},
+    {"OR", "A, d", 3}, {"OR", "A, !a", 4}, {"OR", "A, (X)", 3}, {"OR", "A, [d+X]", 6},
+    {"OR", "A, #i", 2}, {"OR", "d, d", 6}, {"OR1", "C, m.b", 5}, {"ASL", "d", 4},
+    {"ASL", "!a", 5}, {"PUSH", "PSW", 4}, {"TSET1", "!a", 6}, {"BRK", "", 8},
+    // 0x10
+    {"BPL", "r", 2}, {"TCALL", "1", 8}, {"CLR1", "d.0", 4}, {"BBC", "d.0, r", 5},
+    {"OR", "A, d+X", 4}, {"OR", "A, !a+X", 5}, {"OR", "A, !a+Y", 5}, {"OR", "A, [d]+Y", 6},
+    {"OR", "d, #i", 5}, {"OR", "(X), (Y)", 5}, {"DECW", "d", 6}, {"ASL", "d+X", 5},
+    {"ASL", "A", 2}, {"DEC", "X", 2}, {"CMP", "X, !a", 4}, {"JMP", "[!a+X]", 6},
+    // 0x20
+    {"CLRP", "", 2}, {"TCALL", "2", 8}, {"SET1", "d.1", 4}, {"BBS", "d.1, r", 5},
+    {"AND", "A, d", 3}, {"AND", "A, !a", 4}, {"AND", "A, (X)", 3}, {"AND", "A, [d+X]", 6},
+    {"AND", "A, #i", 2}, {"AND", "d, d", 6}, {"OR1", "C, /m.b", 5}, {"ROL", "d", 4},
+    {"ROL", "!a", 5}, {"PUSH", "A", 4}, {"CBNE", "d, r", 5}, {"BRA", "r", 2},
+    // 0x30
+    {"BMI", "r", 2}, {"TCALL", "3", 8}, {"CLR1", "d.1", 4}, {"BBC", "d.1, r", 5},
+    {"AND", "A, d+X", 4}, {"AND", "A, !a+X", 5}, {"AND", "A, !a+Y", 5}, {"AND", "A, [d]+Y", 6},
+    {"AND", "d, #i", 5}, {"AND", "(X), (Y)", 5}, {"INCW", "d", 6}, {"ROL", "d+X", 5},
+    {"ROL", "A", 2}, {"INC", "X", 2}, {"CMP", "X, d", 3}, {"CALL", "!a", 8},
+    // 0x40
+    {"SETP", "", 2}, {"TCALL", "4", 8}, {"SET1", "d.2", 4}, {"BBS", "d.2, r", 5},
+    {"EOR", "A, d", 3}, {"EOR", "A, !a", 4}, {"EOR", "A, (X)", 3}, {"EOR", "A, [d+X]", 6},
+    {"EOR", "A, #i", 2}, {"EOR", "d, d", 6}, {"AND1", "C, m.b", 4}, {"LSR", "d", 4},
+    {"LSR", "!a", 5}, {"PUSH", "X", 4}, {"TCLR1", "!a", 6}, {"PCALL", "u", 6},
+    // 0x50
+    {"BVC", "r", 2}, {"TCALL", "5", 8}, {"CLR1", "d.2", 4}, {"BBC", "d.2, r", 5},
+    {"EOR", "A, d+X", 4}, {"EOR", "A, !a+X", 5}, {"EOR", "A, !a+Y", 5}, {"EOR", "A, [d]+Y", 6},
+    {"EOR", "d, #i", 5}, {"EOR", "(X), (Y)", 5}, {"CMPW", "YA, d", 4}, {"LSR", "d+X", 5},
+    {"LSR", "A", 2}, {"MOV", "X, A", 2}, {"CMP", "Y, !a", 4}, {"JMP", "!a", 3},
+    // 0x60
+    {"CLRC", "", 2}, {"TCALL", "6", 8}, {"SET1", "d.3", 4}, {"BBS", "d.3, r", 5},
+    {"CMP", "A, d", 3}, {"CMP", "A, !a", 4}, {"CMP", "A, (X)", 3}, {"CMP", "A, [d+X]", 6},
+    {"CMP", "A, #i", 2}, {"CMP", "d, d", 6}, {"AND1", "C, /m.b", 4}, {"ROR", "d", 4},
+    {"ROR", "!a", 5}, {"PUSH", "Y", 4}, {"DBNZ", "d, r", 5}, {"RET", "", 5},
+    // 0x70
+    {"BVS", "r", 2}, {"TCALL", "7", 8}, {"CLR1", "d.3", 4}, {"BBC", "d.3, r", 5},
+    {"CMP", "A, d+X", 4}, {"CMP", "A, !a+X", 5}, {"CMP", "A, !a+Y", 5}, {"CMP", "A, [d]+Y", 6},
+    {"CMP", "d, #i", 5}, {"CMP", "(X), (Y)", 5}, {"ADDW", "YA, d", 5}, {"ROR", "d+X", 5},
+    {"ROR", "A", 2}, {"MOV", "A, X", 2}, {"CMP", "Y, d", 3}, {"RETI", "", 6},
+    // 0x80
+    {"SETC", "", 2}, {"TCALL", "8", 8}, {"SET1", "d.4", 4}, {"BBS", "d.4, r", 5},
+    {"ADC", "A, d", 3}, {"ADC", "A, !a", 4}, {"ADC", "A, (X)", 3}, {"ADC", "A, [d+X]", 6},
+    {"ADC", "A, #i", 2}, {"ADC", "d, d", 6}, {"EOR1", "C, m.b", 5}, {"DEC", "d", 4},
+    {"DEC", "!a", 5}, {"MOV", "Y, #i", 2}, {"POP", "PSW", 4}, {"MOV", "d, #i", 5},
+    // 0x90
+    {"BCC", "r", 2}, {"TCALL", "9", 8}, {"CLR1", "d.4", 4}, {"BBC", "d.4, r", 5},
+    {"ADC", "A, d+X", 4}, {"ADC", "A, !a+X", 5}, {"ADC", "A, !a+Y", 5}, {"ADC", "A, [d]+Y", 6},
+    {"ADC", "d, #i", 5}, {"ADC", "(X), (Y)", 5}, {"SUBW", "YA, d", 5}, {"DEC", "d+X", 5},
+    {"DEC", "A", 2}, {"MOV", "X, SP", 2}, {"DIV", "YA, X", 12}, {"XCN", "A", 5},
+    // 0xA0
+    {"EI", "", 3}, {"TCALL", "10", 8}, {"SET1", "d.5", 4}, {"BBS", "d.5, r", 5},
+    {"SBC", "A, d", 3}, {"SBC", "A, !a", 4}, {"SBC", "A, (X)", 3}, {"SBC", "A, [d+X]", 6},
+    {"SBC", "A, #i", 2}, {"SBC", "d, d", 6}, {"MOV1", "C, m.b", 4}, {"INC", "d", 4},
+    {"INC", "!a", 5}, {"CMP", "Y, #i", 2}, {"POP", "A", 4}, {"MOV", "(X)+, A", 4},
+    // 0xB0
+    {"BCS", "r", 2}, {"TCALL", "11", 8}, {"CLR1", "d.5", 4}, {"BBC", "d.5, r", 5},
+    {"SBC", "A, d+X", 4}, {"SBC", "A, !a+X", 5}, {"SBC", "A, !a+Y", 5}, {"SBC", "A, [d]+Y", 6},
+    {"SBC", "d, #i", 5}, {"SBC", "(X), (Y)", 5}, {"MOVW", "YA, d", 5}, {"INC", "d+X", 5},
+    {"INC", "A", 2}, {"MOV", "SP, X", 2}, {"DAS", "A", 3}, {"MOV", "A, (X)+", 4},
+    // 0xC0
+    {"DI", "", 3}, {"TCALL", "12", 8}, {"SET1", "d.6", 4}, {"BBS", "d.6, r", 5},
+    {"MOV", "d, A", 4}, {"MOV", "!a, A", 5}, {"MOV", "(X), A", 4}, {"MOV", "[d+X], A", 7},
+    {"CMP", "X, #i", 2}, {"MOV", "!a, X", 5}, {"MOV1", "m.b, C", 6}, {"MOV", "d, Y", 4},
+    {"MOV", "!a, Y", 5}, {"MOV", "X, #i", 2}, {"POP", "X", 4}, {"MUL", "YA", 9},
+    // 0xD0
+    {"BNE", "r", 2}, {"TCALL", "13", 8}, {"CLR1", "d.6", 4}, {"BBC", "d.6, r", 5},
+    {"MOV", "d+X, A", 5}, {"MOV", "!a+X, A", 6}, {"MOV", "!a+Y, A", 6}, {"MOV", "[d]+Y, A", 7},
+    {"MOV", "d, X", 4}, {"MOV", "d+Y, X", 5}, {"MOVW", "d, YA", 5}, {"MOV", "d+X, Y", 5},
+    {"DEC", "Y", 2}, {"MOV", "A, Y", 2}, {"CBNE", "d+X, r", 6}, {"DAA", "A", 3},
+    // 0xE0
+    {"CLRV", "", 2}, {"TCALL", "14", 8}, {"SET1", "d.7", 4}, {"BBS", "d.7, r", 5},
+    {"MOV", "A, d", 3}, {"MOV", "A, !a", 4}, {"MOV", "A, (X)", 3}, {"MOV", "A, [d+X]", 6},
+    {"MOV", "A, #i", 2}, {"MOV", "X, !a", 4}, {"NOT1", "m.b", 5}, {"MOV", "Y, d", 3},
+    {"MOV", "Y, !a", 4}, {"NOTC", "", 3}, {"POP", "Y", 4}, {"SLEEP", "", 3},
+    // 0xF0
+    {"BEQ", "r", 2}, {"TCALL", "15", 8}, {"CLR1", "d.7", 4}, {"BBC", "d.7, r", 5},
+    {"MOV", "A, d+X", 4}, {"MOV", "A, !a+X", 5}, {"MOV", "A, !a+Y", 5}, {"MOV", "A, [d]+Y", 6},
+    {"MOV", "X, d", 3}, {"MOV", "X, d+Y", 4}, {"MOV", "d, d", 5}, {"MOV", "Y, d+X", 4},
+    {"INC", "Y", 2}, {"MOV", "Y, A", 2}, {"DBNZ", "Y, r", 4}, {"STOP", "", 3},
+};
+
+// Opcode of the instruction written as 'mnemonic operands', in the table's syntax, or -1. Usable
+// at compile time, e.g. spc700_find_opcode("MOV", "A, #i") is 0xE8.
+constexpr int spc700_find_opcode(std::string_view mnemonic, std::string_view operands)
+{
+  for (int opcode = 0; opcode < 256; ++opcode)
+    if (mnemonic == SPC700_OPCODES[opcode].mnemonic && operands == SPC700_OPCODES[opcode].operands)
+      return opcode;
+  return -1;
+}
+
+static_assert(spc700_find_opcode("MOV", "A, #i") == 0xE8);
+static_assert(spc700_find_opcode("MOV1", "m.b, C") == 0xCA && SPC700_OPCODES[0xCA].length == 3);
+static_assert(SPC700_OPCODES[0x8F].length == 3 && SPC700_OPCODES[0xDE].length == 3);
+
+// The encoded fields of an instruction, in the order they appear in its operands
+struct SPC700Fields
+{
+  unsigned count = 0;
+  char kind[2] = {};   // Placeholder of each field, 'm' for m.b
+  unsigned offset[2] = {}; // Where each field's bytes start, after the opcode
+};
+
+constexpr SPC700Fields spc700_fields(const SPC700Opcode &op)
+{
+  SPC700Fields fields;
+  for (const char *c = op.operands; *c; ++c)
+    if (SPC700Opcode::is_field(*c) && *c != 'b')
+      fields.kind[fields.count++] = *c;
+
+  // Source first, except that a branch offset always comes last
+  unsigned offset = 0;
+  const bool reversed = fields.count == 2 && fields.kind[1] != 'r';
+  for (unsigned i = 0; i < fields.count; ++i)
+  {
+    const unsigned field = reversed ? fields.count - 1 - i : i;
+    fields.offset[field] = offset;
+    offset += SPC700Opcode::field_size(fields.kind[field]);
+  }
+  return fields;
+}
+
+// Writes the instruction at 'bytes', whose address is 'pc', to 'out' as text (branch targets as
+// addresses) and returns its length in bytes. Does not allocate, so it can run per instruction in
+// traces.
+inline unsigned spc700_disassemble(const u8 *bytes, u16 pc, char *out, unsigned size)
+{
+  const SPC700Opcode &op = SPC700_OPCODES[bytes[0]];
+  const SPC700Fields fields = spc700_fields(op);
+
+  unsigned length = snprintf(out, size, op.operands[0] ? "%s " : "%s", op.mnemonic);
+  unsigned field = 0;
+  u16 word = 0;
+  for (const char *c = op.operands; *c && length < size; ++c)
+  {
+    if (!SPC700Opcode::is_field(*c))
+    {
+      out[length++] = *c;
+      continue;
+    }
+
+    if (*c != 'b')
+    {
+      const u8 *data = bytes + 1 + fields.offset[field++];
+      word = (SPC700Opcode::field_size(*c) == 2) ? (data[0] | (data[1] << 8)) : data[0];
+    }
+
+    if (*c == 'a')
+      length += snprintf(out + length, size - length, "$%04X", word);
+    else if (*c == 'm')
+      length += snprintf(out + length, size - length, "$%04X", word & 0x1FFF);
+    else if (*c == 'b')
+      length += snprintf(out + length, size - length, "%u", word >> 13);
+    else if (*c == 'r')
+      length += snprintf(out + length, size - length, "$%04X", (u16)(pc + op.length + (s8)word));
+    else
+      length += snprintf(out + length, size - length, "$%02X", word);
+  }
+  if (size)
+    out[length < size ? length : size - 1] = 0;
+  return op.length;
+}
@@ -3,135 +3,39 @@
 #include <array>
 
 #include "BasicBench.h"
+#include "DSPRender.h"
+#include "RAM.h"
 #include "VTestDSP.h"
 #include "VTestDSP_DSP.h"
 #include "VTestDSP_TestDSP.h"
 #include "types.h"
 #include "wave.h"
 
-const unsigned DSP_CYCLES_PER_SAMPLE = 64;
-const unsigned DSP_CYCLES_PER_SEC = DSP_AUDIO_RATE * DSP_CYCLES_PER_SAMPLE;
 double global_time = 0;
 
-class RAM
-{
-private:
-  std::array<u8, 64 * 1024> data;
-
-public:
-  void put(u16 addr, u8 val) { data[addr] = val; }
-  u8 get(u16 addr) { return data[addr]; }
-
-  void load(const char *path)
-  {
-    auto file = fopen(path, "rb");
-    fseek(file, 0, SEEK_END);
-    const u64 file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    fread(&data[0], sizeof(u8), file_size, file);
-    fclose(file);
-  }
-};
-
 class SPCDSPBench : public BasicBench<VTestDSP>
 {
 public:
 };
 
-const char *const VOICE_STATES[] = {"i", "H", "D", "P", ".", "E"};
-
 void dsp_test_wave_out(SPCDSPBench &bench, const char *brr_file_path)
 {
   bench.reset();
-  WaveRecorder recorder;
-
-  RAM ram;
-  ram.load(brr_file_path);
-
-  // f * 2**(n / 12)
-  // C Major (C E G C)
-  const unsigned pitch[] = {4096, 5161, 6137, 8192, 2048, 1024, 512, 256};
-  const unsigned MAXVOL = 0xEF;
-  const unsigned Q = MAXVOL / 8;
-  const unsigned vol[] = {Q, Q, Q, 0, 0, 0, 0, 0 };
-
-  for (int v = 0; v < 8; v++)
+  WaveWriter recorder;
+  if (!recorder.open("./build/dsp_test_wave_out.wav"))
   {
-    const unsigned vpitch = pitch[v] * 1 / 8;
-
-    // Pitch low (x2)
-    bench->dsp_reg_address = (v << 4) | 2;
-    bench->dsp_reg_data_in = vpitch & 0xFF;
-    bench->dsp_reg_write_enable = 1;
-    bench.tick();
-
-    // Pitch high (x3)
-    bench->dsp_reg_address = (v << 4) | 3;
-    bench->dsp_reg_data_in = (vpitch >> 8) & 0xFF;
-    bench->dsp_reg_write_enable = 1;
-    bench.tick();
-
-    // Volume Left (x0)
-    bench->dsp_reg_address = (v << 4) | 0;
-    bench->dsp_reg_data_in = vol[v];
-    bench->dsp_reg_write_enable = 1;
-    bench.tick();
-
-    // Volume Right (x1)
-    bench->dsp_reg_address = (v << 4) | 1;
-    bench->dsp_reg_data_in = vol[v];
-    bench->dsp_reg_write_enable = 1;
-    bench.tick();
+    printf("Could not write ./build/dsp_test_wave_out.wav\n");
+    return;
   }
 
-  bench->dsp_reg_write_enable = 0;
-
-  for (int i = 0; i < DSP_CYCLES_PER_SAMPLE * 32000 * 5; ++i)
-  {
-    const unsigned major_step = bench->major_step;
-
-    // Logging
-    if (0)
-    {
-      if (major_step == 0)
-      {
-        // printf("-------------------------------------\n");
-        // printf("                      0 1 2 3 4 5 6 7 G\n");
-      }
-      // printf("[%08u] : major %2u ", i, major_step);
-      for (int v = 0; v < 8; v++)
-      {
-        const unsigned voice_state = (bench->voice_states_out >> (v * 4)) & 0b1111;
-        printf("%s ", VOICE_STATES[voice_state]);
-      }
-      printf(". | ");
-      for (int v = 0; v < 8; v++)
-      {
-        // const unsigned pitch = bench->TestDSP__DOT__dsp__DOT__decoder_pitch[v];
-        // printf("%6u ", pitch);
-      }
-      {
-        const unsigned current_voice = bench->TestDSP->dsp->current_voice;
-        const unsigned ram_address = bench->ram_address;
-        // printf("current_voice %u ram_addr 0x%0X", current_voice, ram_address);
-      }
-      // printf("\n");
-    }
-
-    if (major_step == DSP_CYCLES_PER_SAMPLE-1)
-    {
-      // printf("%d\n", *(s16*)&bench->dac_out_l);
-      recorder.push(bench->dac_out_l, bench->dac_out_r);
-    }
-
-    //////////////////////
+  RAM ram;
+  ram.load(brr_file_path);
 
-    bench.tick();
+  dsp_write_test_registers(bench);
+  dsp_render(bench, ram, 32000 * 5, recorder);
 
-    // Settle RAM access
-    bench->ram_data = ram.get(bench->ram_address);
-  }
-  recorder.save("./build/dsp_test_wave_out.wav");
+  if (!recorder.close())
+    printf("Failed to write the whole render\n");
   printf("Simulated %llu ticks\n", bench.time());
 }
 
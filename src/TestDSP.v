@@ -19,10 +19,21 @@ module TestDSP(
 `endif
 
   output [15:0] ram_address,
+`ifndef DPI_RAM
   input [7:0] ram_data,
+`endif
   output [5:0] major_step
 );
 
+`ifdef DPI_RAM
+// Verilated with -DDPI_RAM, RAM is read straight from the simulator's memory (see DPIRAM.h) instead
+// of the bench driving ram_data after every clock.
+import "DPI-C" function int dpi_ram_read(input int address);
+
+wire [31:0] dpi_ram_word = dpi_ram_read({16'b0, ram_address});
+wire [7:0] ram_data = dpi_ram_word[7:0];
+`endif
+
 // wire [15:0] address;
 // wire [7:0] data;
 wire write_enable;
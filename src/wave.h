@@ -1,4 +1,19 @@
 #pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "types.h"
 
 const unsigned DSP_AUDIO_RATE = 32000;
@@ -11,6 +26,21 @@ namespace Wave
     u32 chunkSize;
     u32 chunkFormat;
   };
+  // Space for the sizes that don't fit in 32 bits. It is a JUNK chunk, which readers skip, unless
+  // the file grows past 4 GiB and becomes RF64. The 64 bit sizes are split into 32 bit halves as in
+  // the RF64 spec (EBU Tech 3306).
+  struct DS64SubChunk
+  {
+    u32 chunkId;
+    u32 chunkSize;
+    u32 riffSizeLow;
+    u32 riffSizeHigh;
+    u32 dataSizeLow;
+    u32 dataSizeHigh;
+    u32 sampleCountLow;
+    u32 sampleCountHigh;
+    u32 tableLength;
+  };
   struct FMTSubChunk
   {
     u32 subchunk1ID;
@@ -27,9 +57,19 @@ namespace Wave
     u32 subchunk2ID;
     u32 subchunk2Size;
   };
+
+  // Everything before the samples
+  struct Header
+  {
+    RiffDescriptor riff;
+    DS64SubChunk ds64;
+    FMTSubChunk fmt;
+    DataSubChunk data;
+  };
+  static_assert(sizeof(Header) == 80, "WAV header must not be padded");
 };
 
-u32 rev(u32 in)
+inline u32 rev(u32 in)
 {
   const u32 a = (in >> 0) & 0xFF;
   const u32 b = (in >> 8) & 0xFF;
@@ -38,6 +78,200 @@ u32 rev(u32 in)
   return (a << 24) | (b << 16) | (c << 8) | (d << 0);
 }
 
+// Streams 16 bit stereo frames to a WAV file, so that renders of any length run in constant memory
+// and everything up to the last full chunk is on disk if the process dies. Frames are collected in
+// fixed-size chunks, which a background thread writes out with pwrite() while the next ones fill.
+// The sizes in the header are patched after every chunk, so a file cut short is still a valid WAV
+// of the chunks written so far; close() adds the last partial one. Past 4 GiB the file becomes RF64.
+// http://soundfile.sapp.org/doc/WaveFormat/
+class WaveWriter
+{
+public:
+  static constexpr u32 ChunkFrames = 64 * 1024; // 256 KiB per write
+  static constexpr u32 NumChunks = 4;
+
+  WaveWriter() = default;
+  WaveWriter(const WaveWriter &) = delete;
+  WaveWriter &operator=(const WaveWriter &) = delete;
+
+  ~WaveWriter() { close(); }
+
+  // Creates (or truncates) the file. Returns false if it can't be written.
+  bool open(const char *path)
+  {
+    close();
+
+    m_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+      return false;
+
+    if (!m_chunks)
+      m_chunks.reset(new s16[NumChunks * ChunkFrames * 2]);
+    m_fill = 0;
+    m_queued = 0;
+    m_written = 0;
+    m_closing = false;
+    m_failed = false;
+
+    // Sizes are kept current by the writer thread, then close()
+    if (!write_header(0))
+    {
+      ::close(m_fd);
+      m_fd = -1;
+      return false;
+    }
+
+    m_thread = std::thread([this] { write_chunks(); });
+    return true;
+  }
+
+  bool is_open() const { return m_fd >= 0; }
+
+  void push(s16 left, s16 right)
+  {
+    s16 *frame = chunk(m_queued) + 2 * m_fill;
+    frame[0] = left;
+    frame[1] = right;
+    if (++m_fill == ChunkFrames)
+      queue_chunk();
+  }
+
+  // 'samples' holds 'num_frames' interleaved L/R frames
+  void push_frames(const s16 *samples, u64 num_frames)
+  {
+    while (num_frames)
+    {
+      const u32 count = (u32)std::min<u64>(num_frames, ChunkFrames - m_fill);
+      memcpy(chunk(m_queued) + 2 * m_fill, samples, count * 2 * sizeof(s16));
+      samples += count * 2;
+      num_frames -= count;
+      m_fill += count;
+      if (m_fill == ChunkFrames)
+        queue_chunk();
+    }
+  }
+
+  u64 num_frames() const { return m_queued * ChunkFrames + m_fill; }
+
+  // Writes what's left and the final header. Returns false if the file wasn't open, or any of it
+  // could not be written.
+  bool close()
+  {
+    if (m_fd < 0)
+      return false;
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closing = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+
+    bool ok = !m_failed;
+    ok = ok && write_at(chunk(m_queued), m_fill * FrameBytes, chunk_offset(m_queued));
+    ok = ok && write_header(num_frames());
+    ok = (::close(m_fd) == 0) && ok;
+    m_fd = -1;
+    return ok;
+  }
+
+private:
+  static constexpr u32 FrameBytes = 2 * sizeof(s16);
+  static constexpr u64 ChunkBytes = (u64)ChunkFrames * FrameBytes;
+
+  s16 *chunk(u64 index) { return m_chunks.get() + (index % NumChunks) * ChunkFrames * 2; }
+  static u64 chunk_offset(u64 index) { return sizeof(Wave::Header) + index * ChunkBytes; }
+
+  // Hands the full chunk to the writer thread, waiting for it if every chunk is still queued
+  void queue_chunk()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ++m_queued;
+    m_fill = 0;
+    m_cv.notify_all();
+    m_cv.wait(lock, [&] { return m_queued - m_written < NumChunks; });
+  }
+
+  // Writer thread: writes queued chunks in order until closed
+  void write_chunks()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+      m_cv.wait(lock, [&] { return m_written < m_queued || m_closing; });
+      if (m_written == m_queued)
+        return;
+
+      const u64 index = m_written;
+      lock.unlock();
+      // Chunks are written in order, so the header can cover everything up to this one
+      const bool ok = write_at(chunk(index), ChunkBytes, chunk_offset(index)) && write_header((index + 1) * ChunkFrames);
+      lock.lock();
+
+      m_failed = m_failed || !ok;
+      ++m_written;
+      m_cv.notify_all();
+    }
+  }
+
+  bool write_at(const void *data, u64 size, u64 offset)
+  {
+    const u8 *bytes = (const u8 *)data;
+    while (size)
+    {
+      const ssize_t written = pwrite(m_fd, bytes, size, (off_t)offset);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0)
+        return false;
+      bytes += written;
+      size -= written;
+      offset += written;
+    }
+    return true;
+  }
+
+  bool write_header(u64 frames)
+  {
+    const u64 data_size = frames * FrameBytes;
+    const u64 riff_size = sizeof(Wave::Header) - 8 + data_size;
+    const bool rf64 = riff_size > 0xFFFFFFFF;
+
+    Wave::Header header;
+    header.riff = {rev(rf64 ? 0x52463634 : 0x52494646), rf64 ? 0xFFFFFFFF : (u32)riff_size, rev(0x57415645)};
+    header.ds64 = {rev(rf64 ? 0x64733634 : 0x4A554E4B), sizeof(Wave::DS64SubChunk) - 8, 0, 0, 0, 0, 0, 0, 0};
+    if (rf64)
+    {
+      header.ds64.riffSizeLow = (u32)riff_size;
+      header.ds64.riffSizeHigh = (u32)(riff_size >> 32);
+      header.ds64.dataSizeLow = (u32)data_size;
+      header.ds64.dataSizeHigh = (u32)(data_size >> 32);
+      header.ds64.sampleCountLow = (u32)frames;
+      header.ds64.sampleCountHigh = (u32)(frames >> 32);
+    }
+    header.fmt = {rev(0x666d7420), 16, 1, 2, DSP_AUDIO_RATE, DSP_AUDIO_RATE * FrameBytes, FrameBytes, 16};
+    header.data = {rev(0x64617461), rf64 ? 0xFFFFFFFF : (u32)data_size};
+    return write_at(&header, sizeof(header), 0);
+  }
+
+  int m_fd = -1;
+  std::unique_ptr<s16[]> m_chunks;
+  std::thread m_thread;
+
+  // Producer only: frames in the chunk being filled
+  u32 m_fill = 0;
+
+  // Chunks handed to the writer thread, and those it has written. Only the producer changes
+  // m_queued, and only the writer thread m_written.
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  u64 m_queued = 0;
+  u64 m_written = 0;
+  bool m_closing = false;
+  bool m_failed = false;
+};
+
+// Keeps a whole render in memory, for tools that compare renders against each other
 class WaveRecorder
 {
 private:
@@ -51,27 +285,60 @@ public:
     m_samples.push_back(right);
   }
 
-  void save(const char *path)
-  {
-    // http://soundfile.sapp.org/doc/WaveFormat/
+  u64 num_frames() const { return m_samples.size() / 2; }
+  const s16 *samples() const { return m_samples.data(); }
 
+  // Returns false if the file could not be written
+  bool save(const char *path) const
+  {
     assert(m_samples.size() % 2 == 0);
-    const u32 dataSize = m_samples.size() * 2;
 
-    auto f = fopen(path, "wb");
-    {
-      Wave::RiffDescriptor riff{rev(0x52494646), 36 + dataSize, rev(0x57415645)};
-      fwrite(&riff, sizeof(riff), 1, f);
-    }
-    {
-      Wave::FMTSubChunk fmt{rev(0x666d7420), 16, 1, 2, DSP_AUDIO_RATE, DSP_AUDIO_RATE * 2 * 2, 4, 16};
-      fwrite(&fmt, sizeof(fmt), 1, f);
-    }
+    WaveWriter writer;
+    if (!writer.open(path))
+      return false;
+    writer.push_frames(m_samples.data(), num_frames());
+    return writer.close();
+  }
+};
+
+// Reads 'num_frames' L/R frames starting at 'first_frame' from a 16 bit stereo WAV or RF64 file
+// (e.g. one written by WaveWriter), without loading the rest of the file. Returns the number of
+// frames read.
+inline u64 read_wave_frames(const char *path, u64 first_frame, u64 num_frames, s16 *out)
+{
+  auto f = fopen(path, "rb");
+  if (!f)
+    return 0;
+
+  // Find the samples, skipping any chunks before them
+  Wave::RiffDescriptor riff;
+  Wave::DS64SubChunk ds64 = {};
+  Wave::DataSubChunk chunk;
+  u64 data_size = 0;
+  bool found = fread(&riff, sizeof(riff), 1, f) == 1;
+  while (found && fread(&chunk, sizeof(chunk), 1, f) == 1)
+  {
+    if (chunk.subchunk2ID == rev(0x64617461))
     {
-      Wave::DataSubChunk data{rev(0x64617461), dataSize};
-      fwrite(&data, sizeof(data), 1, f);
+      const bool rf64 = riff.chunkId == rev(0x52463634);
+      data_size = rf64 ? ds64.dataSizeLow | ((u64)ds64.dataSizeHigh << 32) : chunk.subchunk2Size;
+      break;
     }
-    fwrite(&m_samples[0], sizeof(u16), m_samples.size(), f);
-    fclose(f);
+    if (chunk.subchunk2ID == rev(0x64733634) && chunk.subchunk2Size >= sizeof(ds64) - 8)
+      found = fread(&ds64.riffSizeLow, sizeof(ds64) - 8, 1, f) == 1 &&
+              fseeko(f, chunk.subchunk2Size - (sizeof(ds64) - 8), SEEK_CUR) == 0;
+    else
+      found = fseeko(f, chunk.subchunk2Size + (chunk.subchunk2Size & 1), SEEK_CUR) == 0;
   }
-};
\ No newline at end of file
+
+  u64 frames_read = 0;
+  const u64 total_frames = data_size / 4;
+  if (first_frame < total_frames)
+  {
+    num_frames = std::min(num_frames, total_frames - first_frame);
+    if (fseeko(f, (off_t)(first_frame * 4), SEEK_CUR) == 0)
+      frames_read = fread(out, sizeof(s16) * 2, num_frames, f);
+  }
+  fclose(f);
+  return frames_read;
+}
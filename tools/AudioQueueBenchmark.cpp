@@ -0,0 +1,98 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "audio_queue.h"
+#include "types.h"
+
+// Streams frames through AudioQueue from a producer thread to a consumer thread, as the simulation
+// thread and the audio callback do, for a range of producer/consumer block sizes. Reports frames/sec
+// and how often each side found the queue full/empty and had to wait, and checks that every frame
+// arrives intact and in order.
+
+struct Result
+{
+  double seconds = 0;
+  u64 producer_spins = 0; // Times the producer found too little free space
+  u64 consumer_spins = 0; // Times the consumer found too few frames
+  bool intact = true;
+};
+
+// Frame i carries i in its two samples, so the consumer can check the order
+Result stream(u64 num_frames, u32 push_block, u32 consume_block)
+{
+  AudioQueue queue;
+  Result result;
+
+  const auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]()
+                       {
+                         std::vector<s16> block(push_block * 2);
+                         for (u64 sent = 0; sent < num_frames; sent += push_block)
+                         {
+                           for (u32 i = 0; i < push_block; ++i)
+                           {
+                             block[2 * i] = (s16)(sent + i);
+                             block[2 * i + 1] = (s16)((sent + i) >> 16);
+                           }
+                           while (queue.freeFrames() < push_block)
+                           {
+                             ++result.producer_spins;
+                             std::this_thread::yield();
+                           }
+                           queue.pushFrames(block.data(), push_block);
+                         } });
+
+  std::vector<s16> block(consume_block * 2);
+  for (u64 received = 0; received < num_frames; received += consume_block)
+  {
+    while (queue.availableFrames() < consume_block)
+    {
+      ++result.consumer_spins;
+      std::this_thread::yield();
+    }
+    queue.consumeFrames(block.data(), consume_block);
+    for (u32 i = 0; i < consume_block; ++i)
+    {
+      if (block[2 * i] != (s16)(received + i) || block[2 * i + 1] != (s16)((received + i) >> 16))
+        result.intact = false;
+    }
+  }
+  producer.join();
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  result.seconds = elapsed.count();
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  const u64 num_frames = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1ull << 26;
+
+  // Block sizes must divide num_frames, so both sides move exactly num_frames
+  const u32 push_blocks[] = {1, 64, 256, 4096};
+  const u32 consume_blocks[] = {256, 4096};
+
+  printf("%llu frames per run\n", (unsigned long long)num_frames);
+  printf("%10s %10s %16s %16s %16s\n", "push", "consume", "frames/sec", "producer spins", "consumer spins");
+
+  bool intact = true;
+  for (u32 consume_block : consume_blocks)
+  {
+    for (u32 push_block : push_blocks)
+    {
+      if (num_frames % push_block || num_frames % consume_block)
+        continue;
+      const Result result = stream(num_frames, push_block, consume_block);
+      printf("%10u %10u %16.0f %16llu %16llu%s\n", push_block, consume_block, num_frames / result.seconds,
+             (unsigned long long)result.producer_spins, (unsigned long long)result.consumer_spins,
+             result.intact ? "" : "  CORRUPT");
+      intact &= result.intact;
+    }
+  }
+  return intact ? 0 : 1;
+}
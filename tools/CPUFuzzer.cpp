@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CPUBench.h"
+#include "CPUModel.h"
+#include "RAM.h"
+#include "SPC700.h"
+#include "types.h"
+
+// Randomized co-simulation of CPU.v against the reference interpreter. Each case is a short random
+// instruction sequence at address 0 (where CPU.v starts) followed by STOP, random registers and
+// random RAM around it. Cases are run in lockstep (see CPUBench.h) on a pool of worker threads,
+// each with its own verilated CPUBench. A failing case is shrunk to a minimal reproducer and
+// written to the corpus directory, one per kind of failure and opcode.
+//
+// The corpus persists between runs: its reproducers are replayed first, and the next case number
+// is saved so that a new run explores new cases. Every case is generated from its number, so any
+// case can be rerun with --seed.
+
+namespace fs = std::filesystem;
+
+double global_time = 0;
+
+double sc_time_stamp()
+{
+  return global_time;
+}
+
+const u8 OPCODE_STOP = 0xFF;
+
+struct Options
+{
+  unsigned jobs = 0;
+  u64 cases = 10000;
+  unsigned length = 8; // Instructions per case
+  const char *corpus_dir = "build/cpu_fuzz_corpus";
+  bool seed_given = false;
+  u64 seed = 0; // Number of the first case
+  std::vector<u8> opcodes; // Empty for all of them
+};
+
+struct FuzzCase
+{
+  u8 A = 0;
+  u8 X = 0;
+  u8 Y = 0;
+  u8 SP = 0;
+  u8 PSW = 0;
+  u64 ram_seed = 0; // RAM is filled from this, or zeroed if 0
+  std::vector<std::vector<u8>> program;
+};
+
+u64 splitmix64(u64 &state)
+{
+  u64 z = (state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+FuzzCase generate_case(const Options &options, u64 number)
+{
+  u64 rng = number;
+  FuzzCase fuzz_case;
+  fuzz_case.A = (u8)splitmix64(rng);
+  fuzz_case.X = (u8)splitmix64(rng);
+  fuzz_case.Y = (u8)splitmix64(rng);
+  fuzz_case.SP = (u8)splitmix64(rng);
+  fuzz_case.PSW = (u8)splitmix64(rng);
+  fuzz_case.ram_seed = splitmix64(rng) | 1;
+
+  for (unsigned i = 0; i < options.length; ++i)
+  {
+    const u64 random = splitmix64(rng);
+    const u8 opcode = options.opcodes.empty() ? (u8)random : options.opcodes[random % options.opcodes.size()];
+    std::vector<u8> instruction = {opcode};
+    for (unsigned j = 1; j < SPC700_OPCODES[opcode].length; ++j)
+      instruction.push_back((u8)(random >> (8 * j)));
+    fuzz_case.program.push_back(instruction);
+  }
+  return fuzz_case;
+}
+
+void build_ram(const FuzzCase &fuzz_case, RAM &ram)
+{
+  u64 rng = fuzz_case.ram_seed;
+  for (u32 address = 0; address < RAM::size(); address += 8)
+  {
+    const u64 random = fuzz_case.ram_seed ? splitmix64(rng) : 0;
+    ram.put(address, 8, (const u8 *)&random);
+  }
+
+  u16 address = 0;
+  for (const std::vector<u8> &instruction : fuzz_case.program)
+  {
+    ram.put(address, instruction.size(), instruction.data());
+    address += instruction.size();
+  }
+  ram.put(address, OPCODE_STOP);
+}
+
+const char *outcome_name(CPULockstepResult::Outcome outcome)
+{
+  switch (outcome)
+  {
+  case CPULockstepResult::MATCH:
+    return "match";
+  case CPULockstepResult::MISMATCH:
+    return "mismatch";
+  case CPULockstepResult::NO_RETIRE:
+    return "no-retire";
+  case CPULockstepResult::HALTED:
+    return "halted";
+  case CPULockstepResult::RAM_MISMATCH:
+    return "ram";
+  }
+  return "";
+}
+
+// Failures are told apart by how the run ended and the opcode it ended on, e.g. mismatch-e8
+std::string failure_key(const CPULockstepResult &result)
+{
+  char key[32];
+  snprintf(key, sizeof(key), "%s-%02x", outcome_name(result.outcome), result.opcode);
+  return key;
+}
+
+// A worker's verilated model and reference, reused for every case it runs. Each model lives in
+// the worker's own context, so workers share no simulation state beyond Verilated's globals.
+struct Worker
+{
+  VerilatedContext context;
+  CPUBench bench{&context};
+  CPUModel model;
+  RAM ram;
+
+  CPULockstepResult run(const FuzzCase &fuzz_case)
+  {
+    build_ram(fuzz_case, ram);
+
+    bench.reset();
+    bench.load_state(ram.raw(), 0, fuzz_case.A, fuzz_case.X, fuzz_case.Y, fuzz_case.SP, fuzz_case.PSW);
+    memcpy(model.ram.data(), ram.raw(), RAM::size());
+    model.set_registers(0, fuzz_case.A, fuzz_case.X, fuzz_case.Y, fuzz_case.SP, fuzz_case.PSW);
+    model.cycles = 0;
+
+    // Leave room for the STOP and for loops made by random branches
+    return cpu_lockstep(bench, model, fuzz_case.program.size() * 4 + 1);
+  }
+
+  // Simplifies a failing case while it keeps failing the same way (see failure_key()): drops
+  // instructions, then zeroes RAM, registers and operand bytes, until none of that helps any more.
+  // Accepting any failure would shrink most cases down to the same trivial one.
+  FuzzCase shrink(FuzzCase fuzz_case, const std::string &key)
+  {
+    const auto fails = [&](const FuzzCase &candidate) {
+      const CPULockstepResult result = run(candidate);
+      return !result.ok() && failure_key(result) == key;
+    };
+    const auto try_change = [&](FuzzCase candidate) {
+      if (!fails(candidate))
+        return false;
+      fuzz_case = std::move(candidate);
+      return true;
+    };
+
+    bool progress = true;
+    while (progress)
+    {
+      progress = false;
+      for (size_t i = fuzz_case.program.size(); i-- > 0;)
+      {
+        FuzzCase candidate = fuzz_case;
+        candidate.program.erase(candidate.program.begin() + i);
+        progress |= try_change(candidate);
+      }
+
+      if (fuzz_case.ram_seed)
+      {
+        FuzzCase candidate = fuzz_case;
+        candidate.ram_seed = 0;
+        progress |= try_change(candidate);
+      }
+
+      for (u8 FuzzCase::*reg : {&FuzzCase::A, &FuzzCase::X, &FuzzCase::Y, &FuzzCase::SP, &FuzzCase::PSW})
+      {
+        if (fuzz_case.*reg)
+        {
+          FuzzCase candidate = fuzz_case;
+          candidate.*reg = 0;
+          progress |= try_change(candidate);
+        }
+      }
+
+      for (size_t i = 0; i < fuzz_case.program.size(); ++i)
+      {
+        for (size_t j = 1; j < fuzz_case.program[i].size(); ++j)
+        {
+          if (fuzz_case.program[i][j])
+          {
+            FuzzCase candidate = fuzz_case;
+            candidate.program[i][j] = 0;
+            progress |= try_change(candidate);
+          }
+        }
+      }
+    }
+    return fuzz_case;
+  }
+};
+
+// Reproducers are text: registers, RAM seed and one instruction per line, in hex and disassembled
+bool save_case(const std::string &path, const FuzzCase &fuzz_case, const CPULockstepResult &result)
+{
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f)
+    return false;
+  fprintf(f, "# %s at instruction %u (opcode %02x at %04x)\n", outcome_name(result.outcome), result.instruction,
+          result.opcode, result.pc);
+  fprintf(f, "registers %02x %02x %02x %02x %02x\n", fuzz_case.A, fuzz_case.X, fuzz_case.Y, fuzz_case.SP,
+          fuzz_case.PSW);
+  fprintf(f, "ram_seed %016llx\n", (unsigned long long)fuzz_case.ram_seed);
+  u16 address = 0;
+  for (const std::vector<u8> &instruction : fuzz_case.program)
+  {
+    char text[32];
+    spc700_disassemble(instruction.data(), address, text, sizeof(text));
+    for (size_t i = 0; i < instruction.size(); ++i)
+      fprintf(f, i ? " %02x" : "%02x", instruction[i]);
+    fprintf(f, "%*s  # %04x %s\n", (int)(3 * (3 - instruction.size())), "", address, text);
+    address += instruction.size();
+  }
+  return fclose(f) == 0;
+}
+
+bool load_case(const std::string &path, FuzzCase &fuzz_case)
+{
+  std::ifstream file(path);
+  if (!file)
+    return false;
+
+  fuzz_case = FuzzCase();
+  std::string line;
+  while (std::getline(file, line))
+  {
+    unsigned a, x, y, sp, psw;
+    unsigned long long seed;
+    if (line.empty() || line[0] == '#')
+      continue;
+    if (sscanf(line.c_str(), "registers %x %x %x %x %x", &a, &x, &y, &sp, &psw) == 5)
+    {
+      fuzz_case.A = a;
+      fuzz_case.X = x;
+      fuzz_case.Y = y;
+      fuzz_case.SP = sp;
+      fuzz_case.PSW = psw;
+    }
+    else if (sscanf(line.c_str(), "ram_seed %llx", &seed) == 1)
+      fuzz_case.ram_seed = seed;
+    else
+    {
+      std::istringstream bytes(line);
+      std::vector<u8> instruction;
+      unsigned byte;
+      while (bytes >> std::hex >> byte)
+        instruction.push_back(byte);
+      if (instruction.empty() || instruction.size() != SPC700_OPCODES[instruction[0]].length)
+        return false;
+      fuzz_case.program.push_back(instruction);
+    }
+  }
+  return true;
+}
+
+std::string next_case_path(const Options &options)
+{
+  return (fs::path(options.corpus_dir) / "next_case").string();
+}
+
+// Shared by the workers
+struct Campaign
+{
+  const Options &options;
+  u64 first_case;
+  std::atomic<u64> next_case;
+  std::atomic<u64> failures = 0;
+  std::atomic<u64> cycles = 0; // SPC700 cycles run by the reference, for the throughput figure
+
+  // Failures that already have a reproducer, from the corpus or found by this run
+  std::mutex mutex;
+  std::map<std::string, std::string> reproducers;
+  unsigned new_reproducers = 0;
+};
+
+void fuzz_worker(Campaign &campaign)
+{
+  auto worker = std::make_unique<Worker>();
+  const u64 end = campaign.first_case + campaign.options.cases;
+  for (u64 number = campaign.next_case++; number < end; number = campaign.next_case++)
+  {
+    const FuzzCase fuzz_case = generate_case(campaign.options, number);
+    const CPULockstepResult result = worker->run(fuzz_case);
+    campaign.cycles += worker->model.cycles;
+    if (result.ok())
+      continue;
+    campaign.failures++;
+
+    {
+      std::lock_guard<std::mutex> lock(campaign.mutex);
+      if (campaign.reproducers.count(failure_key(result)))
+        continue;
+    }
+
+    const std::string key = failure_key(result);
+    const FuzzCase minimal = worker->shrink(fuzz_case, key);
+    const CPULockstepResult minimal_result = worker->run(minimal);
+    const std::string path = (fs::path(campaign.options.corpus_dir) / (key + ".case")).string();
+
+    std::lock_guard<std::mutex> lock(campaign.mutex);
+    if (campaign.reproducers.count(key))
+      continue;
+    campaign.reproducers[key] = path;
+    campaign.new_reproducers++;
+    if (!save_case(path, minimal, minimal_result))
+      printf("Could not write %s\n", path.c_str());
+    printf("case %llu: %s, %zu instruction(s) after shrinking -> %s\n", (unsigned long long)number,
+           outcome_name(minimal_result.outcome), minimal.program.size(), path.c_str());
+    fflush(stdout);
+  }
+}
+
+// Replays the corpus. Reproducers that still fail keep their failure from being reported again.
+void replay_corpus(const Options &options, Campaign &campaign)
+{
+  std::vector<std::string> paths;
+  for (const auto &entry : fs::directory_iterator(options.corpus_dir))
+  {
+    if (entry.is_regular_file() && entry.path().extension() == ".case")
+      paths.push_back(entry.path().string());
+  }
+  std::sort(paths.begin(), paths.end());
+
+  auto worker = std::make_unique<Worker>();
+  unsigned still_failing = 0;
+  for (const std::string &path : paths)
+  {
+    FuzzCase fuzz_case;
+    if (!load_case(path, fuzz_case))
+    {
+      printf("%-60s could not be read\n", path.c_str());
+      continue;
+    }
+
+    const CPULockstepResult result = worker->run(fuzz_case);
+    printf("%-60s %s\n", path.c_str(), result.ok() ? "PASS" : outcome_name(result.outcome));
+    if (!result.ok())
+    {
+      campaign.reproducers[failure_key(result)] = path;
+      still_failing++;
+    }
+  }
+  if (!paths.empty())
+    printf("Corpus: %zu reproducers, %u still failing\n", paths.size(), still_failing);
+}
+
+bool parse_opcodes(const char *list, std::vector<u8> &opcodes)
+{
+  std::istringstream stream(list);
+  std::string opcode;
+  while (std::getline(stream, opcode, ','))
+  {
+    char *end;
+    const unsigned long value = strtoul(opcode.c_str(), &end, 16);
+    if (opcode.empty() || *end || value > 0xFF)
+      return false;
+    opcodes.push_back((u8)value);
+  }
+  return !opcodes.empty();
+}
+
+bool parse_options(int argc, char **argv, Options *options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    if (!strncmp(arg, "--jobs=", 7))
+      options->jobs = atoi(arg + 7);
+    else if (!strncmp(arg, "--cases=", 8))
+      options->cases = strtoull(arg + 8, nullptr, 0);
+    else if (!strncmp(arg, "--length=", 9))
+      options->length = atoi(arg + 9);
+    else if (!strncmp(arg, "--corpus=", 9))
+      options->corpus_dir = arg + 9;
+    else if (!strncmp(arg, "--seed=", 7))
+    {
+      options->seed_given = true;
+      options->seed = strtoull(arg + 7, nullptr, 0);
+    }
+    else if (!strncmp(arg, "--opcodes=", 10))
+    {
+      if (!parse_opcodes(arg + 10, options->opcodes))
+        return false;
+    }
+    else if (arg[0] != '+')
+      return false;
+  }
+
+  if (options->length == 0)
+    return false;
+  if (options->jobs == 0)
+    options->jobs = std::max(1u, std::thread::hardware_concurrency());
+  return true;
+}
+
+int main(int argc, char **argv, char **env)
+{
+  Verilated::commandArgs(argc, argv);
+
+  Options options;
+  if (!parse_options(argc, argv, &options))
+  {
+    printf("Usage: %s [--jobs=N] [--cases=N] [--length=N] [--corpus=dir] [--seed=N] [--opcodes=e8,a8,...]\n",
+           argv[0]);
+    exit(1);
+  }
+  fs::create_directories(options.corpus_dir);
+
+  u64 first_case = options.seed;
+  if (!options.seed_given)
+  {
+    std::ifstream next(next_case_path(options));
+    next >> first_case;
+  }
+
+  Campaign campaign{options, first_case, {first_case}};
+  replay_corpus(options, campaign);
+
+  printf("Running cases %llu to %llu with %u workers\n", (unsigned long long)first_case,
+         (unsigned long long)(first_case + options.cases - 1), options.jobs);
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < options.jobs; ++i)
+    workers.emplace_back(fuzz_worker, std::ref(campaign));
+  for (std::thread &thread : workers)
+    thread.join();
+  const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+  if (!options.seed_given)
+    std::ofstream(next_case_path(options)) << first_case + options.cases << "\n";
+
+  printf("Total: %llu cases, %llu failed, %u new reproducers in %.3f s (%.0f cases/sec, %.0f SPC700 cycles/sec)\n",
+         (unsigned long long)options.cases, (unsigned long long)campaign.failures.load(), campaign.new_reproducers,
+         wall.count(), options.cases / wall.count(), campaign.cycles / wall.count());
+  return campaign.failures ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CPUTrace.h"
+#include "SPC700.h"
+#include "types.h"
+
+// Decodes an instruction trace written by CPUBench --trace, printing one line per instruction or,
+// with --stats, how often each opcode ran. Records can be filtered by index, PC range and opcode.
+// Operands aren't in the trace, so instructions are shown in the opcode table's syntax.
+
+struct Options
+{
+  const char *path = nullptr;
+  u64 from = 0;        // Index of the first record considered
+  u64 count = ~0ull;   // Records printed at most
+  u16 pc_low = 0;
+  u16 pc_high = 0xFFFF;
+  bool opcodes[256] = {}; // Opcodes to keep, or all if none are set
+  bool any_opcode = true;
+  bool stats = false;
+};
+
+bool parse_pc_range(const char *text, Options *options)
+{
+  char *end;
+  const unsigned long low = strtoul(text, &end, 16);
+  unsigned long high = low;
+  if (*end == '-')
+    high = strtoul(end + 1, &end, 16);
+  if (end == text || *end || low > high || high > 0xFFFF)
+    return false;
+  options->pc_low = (u16)low;
+  options->pc_high = (u16)high;
+  return true;
+}
+
+bool parse_opcodes(const char *list, Options *options)
+{
+  std::istringstream stream(list);
+  std::string opcode;
+  while (std::getline(stream, opcode, ','))
+  {
+    char *end;
+    const unsigned long value = strtoul(opcode.c_str(), &end, 16);
+    if (opcode.empty() || *end || value > 0xFF)
+      return false;
+    options->opcodes[value] = true;
+    options->any_opcode = false;
+  }
+  return !options->any_opcode;
+}
+
+bool parse_options(int argc, char **argv, Options *options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    if (!strncmp(arg, "--from=", 7))
+      options->from = strtoull(arg + 7, nullptr, 0);
+    else if (!strncmp(arg, "--count=", 8))
+      options->count = strtoull(arg + 8, nullptr, 0);
+    else if (!strncmp(arg, "--pc=", 5))
+    {
+      if (!parse_pc_range(arg + 5, options))
+        return false;
+    }
+    else if (!strncmp(arg, "--opcodes=", 10))
+    {
+      if (!parse_opcodes(arg + 10, options))
+        return false;
+    }
+    else if (!strcmp(arg, "--stats"))
+      options->stats = true;
+    else if (arg[0] == '-' || options->path)
+      return false;
+    else
+      options->path = arg;
+  }
+  return options->path != nullptr;
+}
+
+// PSW as NVPBHIZC, lowercase for clear flags
+const char *flags_text(u8 psw, char text[9])
+{
+  static const char NAMES[] = "NVPBHIZC";
+  for (unsigned i = 0; i < 8; ++i)
+    text[i] = (psw & (0x80 >> i)) ? NAMES[i] : (char)(NAMES[i] - 'A' + 'a');
+  text[8] = 0;
+  return text;
+}
+
+void print_record(u64 index, const CPUTraceRecord &record)
+{
+  const SPC700Opcode &op = SPC700_OPCODES[record.opcode];
+  char mnemonic[24];
+  snprintf(mnemonic, sizeof(mnemonic), op.operands[0] ? "%s %s" : "%s", op.mnemonic, op.operands);
+  char flags[9];
+  printf("%10llu %12llu  %04x  %02x  %-16s A:%02x X:%02x Y:%02x SP:%02x %s\n", (unsigned long long)index,
+         (unsigned long long)record.cycle, record.pc, record.opcode, mnemonic, record.A, record.X, record.Y,
+         record.SP, flags_text(record.PSW, flags));
+}
+
+void print_stats(const u64 counts[256], u64 total)
+{
+  std::vector<unsigned> opcodes;
+  for (unsigned opcode = 0; opcode < 256; ++opcode)
+  {
+    if (counts[opcode])
+      opcodes.push_back(opcode);
+  }
+  std::sort(opcodes.begin(), opcodes.end(), [&](unsigned a, unsigned b) { return counts[a] > counts[b]; });
+
+  for (unsigned opcode : opcodes)
+  {
+    const SPC700Opcode &op = SPC700_OPCODES[opcode];
+    printf("%02x  %-6s %-12s %12llu  %5.2f%%\n", opcode, op.mnemonic, op.operands, (unsigned long long)counts[opcode],
+           100.0 * counts[opcode] / total);
+  }
+  printf("%llu instructions, %zu distinct opcodes\n", (unsigned long long)total, opcodes.size());
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!parse_options(argc, argv, &options))
+  {
+    printf("Usage: %s [--from=N] [--count=N] [--pc=lo[-hi]] [--opcodes=e8,2f,...] [--stats] trace_file\n", argv[0]);
+    exit(1);
+  }
+
+  CPUTraceReader reader;
+  const char *error = nullptr;
+  if (!reader.open(options.path, &error))
+  {
+    printf("%s %s\n", options.path, error);
+    exit(1);
+  }
+
+  u64 counts[256] = {};
+  u64 matched = 0;
+  u64 index = 0;
+  CPUTraceRecord record;
+  for (; matched < options.count && reader.next(&record); ++index)
+  {
+    if (index < options.from || record.pc < options.pc_low || record.pc > options.pc_high ||
+        (!options.any_opcode && !options.opcodes[record.opcode]))
+      continue;
+
+    matched++;
+    if (options.stats)
+      counts[record.opcode]++;
+    else
+      print_record(index, record);
+  }
+
+  if (options.stats)
+    print_stats(counts, matched);
+
+  if (matched < options.count && index < reader.num_records())
+  {
+    printf("%s is truncated after %llu of %llu records\n", options.path, (unsigned long long)index,
+           (unsigned long long)reader.num_records());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cstring>
+
+#include "BasicBench.h"
+#include "DPIRAM.h"
+#include "DSPRender.h"
+#include "RAM.h"
+#include "VTestDSP.h"
+#include "VTestDSP_DPI.h"
+#include "types.h"
+#include "wave.h"
+
+// Compares the two ways TestDSP can read RAM: the bench driving ram_data after every clock
+// (VTestDSP), and the model reading memory itself through a DPI-C import (VTestDSP_DPI, verilated
+// with -DDPI_RAM). Both render the same sample; the renders must match exactly, and the throughput
+// of each is reported.
+
+double global_time = 0;
+
+double sc_time_stamp()
+{
+  return global_time;
+}
+
+struct Options
+{
+  const char *path = "test_data/13_piano.brr";
+  unsigned seconds = 5;
+  unsigned runs = 3;
+};
+
+struct Timing
+{
+  u64 ticks = 0;
+  double best_seconds = 0; // Fastest of the runs, the least disturbed by the rest of the system
+};
+
+template <class Module>
+Timing time_renders(const Options &options, const RAM &ram, WaveRecorder &recorder)
+{
+  Timing timing;
+  for (unsigned run = 0; run < options.runs; ++run)
+  {
+    BasicBench<Module> bench;
+    WaveRecorder run_recorder;
+    // Attached before reset, so that the polled model never clocks with a stale ram_data and both
+    // models see the same memory on every cycle
+    ram.bind_dpi();
+    bench.attach_ram(ram.raw());
+    bench.reset();
+    dsp_write_test_registers(bench);
+
+    const auto start = std::chrono::steady_clock::now();
+    dsp_render(bench, ram, DSP_AUDIO_RATE * options.seconds, run_recorder);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    timing.ticks = bench.time();
+    if (run == 0 || elapsed.count() < timing.best_seconds)
+      timing.best_seconds = elapsed.count();
+    if (run == 0)
+      recorder = run_recorder;
+  }
+  return timing;
+}
+
+void print_timing(const char *name, const Timing &timing)
+{
+  printf("%-24s %12llu ticks %8.3f s %12.0f ticks/sec\n", name, (unsigned long long)timing.ticks,
+         timing.best_seconds, timing.ticks / timing.best_seconds);
+}
+
+bool parse_options(int argc, char **argv, Options *options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    if (!strncmp(arg, "--seconds=", 10))
+      options->seconds = atoi(arg + 10);
+    else if (!strncmp(arg, "--runs=", 7))
+      options->runs = atoi(arg + 7);
+    else if (arg[0] == '-')
+      return false;
+    else if (arg[0] != '+')
+      options->path = arg;
+  }
+  return options->seconds > 0 && options->runs > 0;
+}
+
+int main(int argc, char **argv, char **env)
+{
+  Verilated::commandArgs(argc, argv);
+
+  Options options;
+  if (!parse_options(argc, argv, &options))
+  {
+    printf("Usage: %s [--seconds=N] [--runs=N] [brr_file_path]\n", argv[0]);
+    exit(1);
+  }
+
+  RAM ram;
+  if (!ram.load(options.path))
+  {
+    printf("Could not load %s\n", options.path);
+    exit(1);
+  }
+
+  WaveRecorder polled, dpi;
+  const Timing polled_timing = time_renders<VTestDSP>(options, ram, polled);
+  const Timing dpi_timing = time_renders<VTestDSP_DPI>(options, ram, dpi);
+
+  print_timing("polled ram_data", polled_timing);
+  print_timing("DPI-C RAM", dpi_timing);
+  printf("DPI-C speedup: %.2fx\n", polled_timing.best_seconds / dpi_timing.best_seconds);
+
+  if (polled.num_frames() != dpi.num_frames() ||
+      memcmp(polled.samples(), dpi.samples(), polled.num_frames() * 2 * sizeof(s16)))
+  {
+    printf("FAIL: renders differ\n");
+    return 1;
+  }
+  return 0;
+}
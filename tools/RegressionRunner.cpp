@@ -0,0 +1,442 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioDigest.h"
+#include "BasicBench.h"
+#include "DSPRender.h"
+#include "RAM.h"
+#include "VDSPVoiceDecoder.h"
+#include "VTestDSP.h"
+#include "types.h"
+#include "wave.h"
+
+// Renders every BRR sample in the corpus through a verilated model, spread over a pool of worker
+// threads. Each worker owns its model instance. A fresh one is made for every file, as reset does not
+// clear every register (e.g. a decoder's current_output), and renders must not depend on which files
+// a worker happened to pick before.
+//
+// Renders are digested and written out as they run rather than recorded, so memory does not grow
+// with --seconds. With --golden, every render is digested (see AudioDigest.h) and checked against a
+// database of known-good digests, turning a listening test into a pass/fail check.
+
+namespace fs = std::filesystem;
+
+double global_time = 0;
+
+double sc_time_stamp()
+{
+  return global_time;
+}
+
+enum class Model
+{
+  DSP,   // VTestDSP with the TestDSP chord
+  Voice, // VDSPVoiceDecoder on its own
+};
+
+struct Options
+{
+  Model model = Model::DSP;
+  unsigned jobs = 0;
+  unsigned seconds = 5;
+  const char *out_dir = nullptr;
+  const char *golden_path = nullptr;
+  const char *golden_wave_dir = nullptr; // Renders of the golden run, written with --out
+  bool update_golden = false;
+  std::vector<std::string> paths;
+};
+
+enum class Verdict
+{
+  None, // Not checked
+  Pass,
+  Fail,
+  New, // No golden digest for this file
+};
+
+struct Result
+{
+  bool loaded = false;
+  const char *load_error = nullptr;
+  u64 ticks = 0;
+  u64 samples = 0;
+  double seconds = 0;
+  AudioDigest digest;
+  Verdict verdict = Verdict::None;
+  u64 first_divergent_frame = 0;
+  u64 divergent_frames_end = 0; // First divergent frame is in [first_divergent_frame, divergent_frames_end)
+};
+
+// Every .brr under 'paths' (files are taken as-is, directories are searched recursively), sorted
+// so that runs are reported in a stable order.
+std::vector<std::string> find_brr_files(const std::vector<std::string> &paths)
+{
+  std::vector<std::string> files;
+  for (const std::string &path : paths)
+  {
+    if (!fs::is_directory(path))
+    {
+      files.push_back(path);
+      continue;
+    }
+
+    for (const auto &entry : fs::recursive_directory_iterator(path))
+    {
+      if (entry.is_regular_file() && entry.path().extension() == ".brr")
+        files.push_back(entry.path().generic_string());
+    }
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// Flattens 'path' into a file name, e.g. test_data/smrpg-samples/x.brr -> test_data_smrpg-samples_x.wav
+std::string output_name(std::string path)
+{
+  for (char &c : path)
+  {
+    if (c == '/' || c == '\\' || c == ' ')
+      c = '_';
+  }
+  return fs::path(path).replace_extension(".wav").string();
+}
+
+// Where a render's frames go as it runs, so that no render is kept in memory: into the digest with
+// --golden, and into a WaveWriter with --out. When there is a golden digest to compare against,
+// the frames of the current chunk are also kept until its hash is known. The first chunk that
+// differs from the golden one (or the trailing partial chunk, if all whole ones match) stays
+// behind for locate_divergence().
+class RenderSink
+{
+public:
+  RenderSink(AudioDigest *digest, const AudioDigest *expected, WaveWriter *writer)
+      : m_digest(digest), m_expected(expected), m_writer(writer)
+  {
+    if (m_expected)
+      m_chunk.resize(AudioDigest::chunk_frames * 2);
+  }
+
+  void push(s16 left, s16 right)
+  {
+    m_num_frames++;
+    if (m_writer)
+      m_writer->push(left, right);
+    if (!m_digest)
+      return;
+
+    m_digest->push(left, right);
+    if (!m_expected || m_diverged)
+      return;
+
+    m_chunk[2 * m_chunk_frames] = left;
+    m_chunk[2 * m_chunk_frames + 1] = right;
+    if (++m_chunk_frames < AudioDigest::chunk_frames)
+      return;
+
+    const std::vector<u64> &expected = m_expected->chunk_hashes();
+    if (m_chunk_index >= expected.size() || m_digest->chunk_hashes()[m_chunk_index] != expected[m_chunk_index])
+    {
+      m_diverged = true;
+      return;
+    }
+    m_chunk_index++;
+    m_chunk_frames = 0;
+  }
+
+  u64 num_frames() const { return m_num_frames; }
+
+  // The kept chunk: its index and its frames so far
+  u64 chunk_index() const { return m_chunk_index; }
+  u64 chunk_frames() const { return m_chunk_frames; }
+  const s16 *chunk() const { return m_chunk.data(); }
+
+private:
+  AudioDigest *m_digest;
+  const AudioDigest *m_expected;
+  WaveWriter *m_writer;
+  u64 m_num_frames = 0;
+  std::vector<s16> m_chunk;
+  u64 m_chunk_index = 0;
+  u64 m_chunk_frames = 0;
+  bool m_diverged = false;
+};
+
+void render(BasicBench<VTestDSP> &bench, const Options &options, const RAM &ram, RenderSink &sink)
+{
+  bench.reset();
+  dsp_write_test_registers(bench);
+  dsp_render(bench, ram, DSP_AUDIO_RATE * options.seconds, sink);
+}
+
+void render(BasicBench<VDSPVoiceDecoder> &bench, const Options &, const RAM &ram, RenderSink &sink)
+{
+  voice_render(bench, ram, sink);
+}
+
+// Narrows down where the render first differs from the golden digest. The chunk hashes bound it to
+// one chunk; if the golden render is on disk, only that chunk of it is read and compared against the
+// chunk 'sink' kept to find the exact frame.
+void locate_divergence(const Options &options, const std::string &file, const RenderSink &sink,
+                       const AudioDigest &golden, Result &result)
+{
+  const u64 chunk = AudioDigest::first_divergent_chunk(result.digest, golden);
+  const u64 chunk_start = chunk * AudioDigest::chunk_frames;
+  const u64 shared_frames = std::min(result.digest.num_frames(), golden.num_frames());
+  result.first_divergent_frame = chunk_start;
+  result.divergent_frames_end = std::min<u64>(chunk_start + AudioDigest::chunk_frames, shared_frames);
+  if (!options.golden_wave_dir || chunk_start >= result.divergent_frames_end || sink.chunk_index() != chunk)
+    return;
+
+  const u64 num_frames = result.divergent_frames_end - chunk_start;
+  std::vector<s16> golden_frames(num_frames * 2);
+  const std::string golden_wave = (fs::path(options.golden_wave_dir) / output_name(file)).string();
+  if (read_wave_frames(golden_wave.c_str(), chunk_start, num_frames, golden_frames.data()) != num_frames)
+    return;
+
+  const s16 *frames = sink.chunk();
+  for (u64 i = 0; i < num_frames; ++i)
+  {
+    if (frames[2 * i] != golden_frames[2 * i] || frames[2 * i + 1] != golden_frames[2 * i + 1])
+    {
+      result.first_divergent_frame = chunk_start + i;
+      result.divergent_frames_end = chunk_start + i + 1;
+      return;
+    }
+  }
+}
+
+void check_golden(const Options &options, const AudioDigest *expected, const std::string &file,
+                  const RenderSink &sink, Result &result)
+{
+  if (!expected)
+  {
+    result.verdict = Verdict::New;
+    return;
+  }
+
+  if (result.digest == *expected)
+  {
+    result.verdict = Verdict::Pass;
+    return;
+  }
+
+  result.verdict = Verdict::Fail;
+  locate_divergence(options, file, sink, *expected, result);
+}
+
+void print_result(const std::string &file, const Result &result)
+{
+  if (!result.loaded)
+  {
+    printf("%-60s failed to load: %s\n", file.c_str(), result.load_error);
+    return;
+  }
+
+  printf("%-60s %8.3f s %12llu ticks %12.0f ticks/sec", file.c_str(), result.seconds,
+         (unsigned long long)result.ticks, result.ticks / result.seconds);
+  switch (result.verdict)
+  {
+  case Verdict::None:
+    break;
+  case Verdict::Pass:
+    printf("  PASS");
+    break;
+  case Verdict::New:
+    printf("  NEW   %016llx peak %d rms %.1f", (unsigned long long)result.digest.hash(), result.digest.peak(),
+           result.digest.rms());
+    break;
+  case Verdict::Fail:
+    if (result.divergent_frames_end == result.first_divergent_frame + 1)
+      printf("  FAIL  first divergent frame %llu", (unsigned long long)result.first_divergent_frame);
+    else
+      printf("  FAIL  first divergent frame in [%llu, %llu)", (unsigned long long)result.first_divergent_frame,
+             (unsigned long long)result.divergent_frames_end);
+    printf(" peak %d rms %.1f", result.digest.peak(), result.digest.rms());
+    break;
+  }
+  printf("\n");
+}
+
+template <class Module>
+void worker(const Options &options, const GoldenDigests &golden, const std::vector<std::string> &files,
+            std::vector<Result> &results, std::atomic<size_t> &next_file, std::mutex &print_mutex)
+{
+  for (size_t i = next_file++; i < files.size(); i = next_file++)
+  {
+    BasicBench<Module> bench;
+    Result &result = results[i];
+    RAM ram;
+    BRRFile brr;
+    result.loaded = brr.open(files[i].c_str());
+    result.load_error = brr.error();
+    if (result.loaded)
+    {
+      ram.load(brr);
+      WaveWriter writer;
+      const std::string out_path = options.out_dir ? (fs::path(options.out_dir) / output_name(files[i])).string() : "";
+      const bool writing = options.out_dir && writer.open(out_path.c_str());
+      if (options.out_dir && !writing)
+        printf("Could not write %s\n", out_path.c_str());
+
+      const AudioDigest *expected = options.golden_path ? golden.find(files[i]) : nullptr;
+      RenderSink sink(options.golden_path ? &result.digest : nullptr, expected, writing ? &writer : nullptr);
+      const auto start = std::chrono::steady_clock::now();
+      render(bench, options, ram, sink);
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+      result.ticks = bench.time();
+      result.samples = sink.num_frames();
+      result.seconds = elapsed.count();
+
+      if (writing && !writer.close())
+        printf("Could not write %s\n", out_path.c_str());
+
+      if (options.golden_path)
+        check_golden(options, expected, files[i], sink, result);
+    }
+
+    std::lock_guard<std::mutex> lock(print_mutex);
+    print_result(files[i], result);
+    fflush(stdout);
+  }
+}
+
+bool parse_options(int argc, char **argv, Options *options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    if (!strcmp(arg, "--model=dsp"))
+      options->model = Model::DSP;
+    else if (!strcmp(arg, "--model=voice"))
+      options->model = Model::Voice;
+    else if (!strncmp(arg, "--jobs=", 7))
+      options->jobs = atoi(arg + 7);
+    else if (!strncmp(arg, "--seconds=", 10))
+      options->seconds = atoi(arg + 10);
+    else if (!strncmp(arg, "--out=", 6))
+      options->out_dir = arg + 6;
+    else if (!strncmp(arg, "--golden=", 9))
+      options->golden_path = arg + 9;
+    else if (!strncmp(arg, "--golden-wavs=", 14))
+      options->golden_wave_dir = arg + 14;
+    else if (!strcmp(arg, "--update-golden"))
+      options->update_golden = true;
+    else if (arg[0] == '-')
+      return false;
+    else if (arg[0] != '+')
+      options->paths.push_back(arg);
+  }
+
+  if (options->paths.empty())
+    options->paths.push_back("test_data");
+  if (options->update_golden && !options->golden_path)
+    return false;
+  if (options->jobs == 0)
+    options->jobs = std::max(1u, std::thread::hardware_concurrency());
+  return true;
+}
+
+int main(int argc, char **argv, char **env)
+{
+  Verilated::commandArgs(argc, argv);
+
+  Options options;
+  if (!parse_options(argc, argv, &options))
+  {
+    printf("Usage: %s [--model=dsp|voice] [--jobs=N] [--seconds=N] [--out=dir]\n"
+           "       [--golden=digests.txt [--update-golden] [--golden-wavs=dir]] [brr files or directories...]\n",
+           argv[0]);
+    exit(1);
+  }
+
+  const std::vector<std::string> files = find_brr_files(options.paths);
+  if (files.empty())
+  {
+    printf("No .brr files found\n");
+    exit(1);
+  }
+  if (options.out_dir)
+    fs::create_directories(options.out_dir);
+
+  GoldenDigests golden;
+  if (options.golden_path && !golden.load(options.golden_path) && !options.update_golden)
+  {
+    printf("Could not load golden digests from %s\n", options.golden_path);
+    exit(1);
+  }
+
+  const unsigned num_workers = std::min<size_t>(options.jobs, files.size());
+  printf("Rendering %zu files with %u workers (%s)\n", files.size(), num_workers,
+         options.model == Model::DSP ? "TestDSP" : "DSPVoiceDecoder");
+
+  std::vector<Result> results(files.size());
+  std::atomic<size_t> next_file(0);
+  std::mutex print_mutex;
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < num_workers; ++i)
+  {
+    if (options.model == Model::DSP)
+      workers.emplace_back(worker<VTestDSP>, std::cref(options), std::cref(golden), std::cref(files), std::ref(results),
+                           std::ref(next_file), std::ref(print_mutex));
+    else
+      workers.emplace_back(worker<VDSPVoiceDecoder>, std::cref(options), std::cref(golden), std::cref(files), std::ref(results),
+                           std::ref(next_file), std::ref(print_mutex));
+  }
+  for (std::thread &thread : workers)
+    thread.join();
+  const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+  unsigned failed = 0;
+  unsigned verdicts[4] = {};
+  u64 total_ticks = 0;
+  u64 total_samples = 0;
+  double total_seconds = 0;
+  for (const Result &result : results)
+  {
+    failed += !result.loaded;
+    verdicts[(int)result.verdict]++;
+    total_ticks += result.ticks;
+    total_samples += result.samples;
+    total_seconds += result.seconds;
+  }
+
+  printf("Total: %zu files (%u failed), %llu ticks, %llu samples in %.3f s wall\n", files.size(), failed,
+         (unsigned long long)total_ticks, (unsigned long long)total_samples, wall.count());
+  printf("Throughput: %.0f ticks/sec aggregate, %.1fx realtime, %.2fx parallel speedup\n",
+         total_ticks / wall.count(), (double)total_samples / DSP_AUDIO_RATE / wall.count(),
+         total_seconds / wall.count());
+
+  if (options.golden_path)
+  {
+    printf("Golden: %u passed, %u failed, %u new\n", verdicts[(int)Verdict::Pass], verdicts[(int)Verdict::Fail],
+           verdicts[(int)Verdict::New]);
+
+    if (options.update_golden)
+    {
+      for (size_t i = 0; i < files.size(); ++i)
+      {
+        if (results[i].loaded)
+          golden.set(files[i], results[i].digest);
+      }
+      if (!golden.save(options.golden_path))
+      {
+        printf("Could not write golden digests to %s\n", options.golden_path);
+        return 1;
+      }
+      printf("Wrote %zu digests to %s\n", golden.size(), options.golden_path);
+      return failed ? 1 : 0;
+    }
+    failed += verdicts[(int)Verdict::Fail];
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "APUFiles.h"
+#include "Backdoor.h"
+#include "BasicBench.h"
+#include "DSPRender.h"
+#include "VAPU.h"
+#include "VAPU_APU.h"
+#include "VAPU_CPU.h"
+#include "VAPU_DSP.h"
+#include "VAPU_APURAM.h"
+#include "types.h"
+#include "wave.h"
+
+// Plays an SPC file on the whole APU (APU.v: CPU, RAM, DSP and I/O registers) with no GUI, streaming
+// the output to a WAV file, and reports how fast the simulation ran. The SPC's state is loaded
+// through the backdoor rather than run up from the IPL ROM: the DSP carries on where it was saved,
+// and the CPU fetches its first instruction from the saved PC. CPU.v decodes only a few opcodes and
+// executes none yet, so it soon halts and what plays is mostly what the DSP had keyed on.
+
+double global_time = 0;
+
+double sc_time_stamp()
+{
+  return global_time;
+}
+
+struct Options
+{
+  const char *path = nullptr;
+  const char *out = "build/spc_render.wav";
+  double seconds = 10;
+};
+
+bool parse_options(int argc, char **argv, Options *options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    if (!strncmp(arg, "--seconds=", 10))
+      options->seconds = atof(arg + 10);
+    else if (!strncmp(arg, "--out=", 6))
+      options->out = arg + 6;
+    else if (arg[0] == '-' || options->path)
+      return false;
+    else
+      options->path = arg;
+  }
+  return options->path != nullptr && options->seconds > 0;
+}
+
+class APUBench : public BasicBench<VAPU>
+{
+public:
+  // Puts the APU in the state saved in 'spc'. The bench must have been reset first, which would
+  // otherwise clear the registers.
+  void load(const SPCFile &spc)
+  {
+    VAPU_APU &apu = *(*this)->APU;
+    const u8 *ram = spc.ram();
+    backdoor_write_ram(*apu.ram, 0, 0x10000, ram);
+    backdoor_write_cpu_registers(*apu.cpu, spc.PC(), spc.A(), spc.X(), spc.Y(), spc.SP(),
+                                 reverse_cpu_flags(spc.PSW()));
+    backdoor_write_dsp_registers(*apu.dsp, spc.dsp_registers());
+    backdoor_write_apu_io(apu, ram + 0xF0);
+
+    // What the SNES last wrote to the ports is lost; the CPU's own last reads are the best guess
+    (*this)->cpu_port_in = ram[0xF4] | (ram[0xF5] << 8) | (ram[0xF6] << 16) | ((u32)ram[0xF7] << 24);
+    (*this)->eval();
+  }
+};
+
+int main(int argc, char **argv, char **env)
+{
+  Verilated::commandArgs(argc, argv);
+
+  Options options;
+  if (!parse_options(argc, argv, &options))
+  {
+    printf("Usage: %s [--seconds=N] [--out=file.wav] file.spc\n", argv[0]);
+    exit(1);
+  }
+
+  SPCFile spc;
+  if (!spc.open(options.path))
+  {
+    printf("%s: %s\n", options.path, spc.error());
+    exit(1);
+  }
+
+  WaveWriter recorder;
+  if (!recorder.open(options.out))
+  {
+    printf("Could not write %s\n", options.out);
+    exit(1);
+  }
+
+  const SPCFile::ID666 &tag = spc.tag();
+  if (!tag.title.empty())
+    printf("%.*s (%.*s)\n", (int)tag.title.size(), tag.title.data(), (int)tag.game.size(), tag.game.data());
+
+  APUBench bench;
+  bench.reset();
+  bench.load(spc);
+
+  const u64 num_cycles = (u64)(DSP_CYCLES_PER_SEC * options.seconds);
+  const auto start = std::chrono::steady_clock::now();
+  bench.run(num_cycles, [&](s16 left, s16 right) { recorder.push(left, right); });
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  const u64 num_frames = recorder.num_frames();
+  if (!recorder.close())
+  {
+    printf("Failed to write the whole render to %s\n", options.out);
+    return 1;
+  }
+
+  const double simulated = (double)num_frames / DSP_AUDIO_RATE;
+  printf("Wrote %llu frames (%.2f s) to %s\n", (unsigned long long)num_frames, simulated, options.out);
+  printf("%llu ticks in %.3f s: %.0f ticks/sec, %.3fx realtime%s\n", (unsigned long long)bench.time(),
+         elapsed.count(), bench.time() / elapsed.count(), simulated / elapsed.count(),
+         bench->cpu_halted ? " (CPU halted)" : "");
+  return 0;
+}
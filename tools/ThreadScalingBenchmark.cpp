@@ -0,0 +1,167 @@
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "BasicBench.h"
+#include "DSPRender.h"
+#include "RAM.h"
+#include "VTestDSP.h"
+#include "VTestDSP_MT2.h"
+#include "VTestDSP_MT4.h"
+#include "VTestDSP_MT8.h"
+#include "types.h"
+#include "wave.h"
+
+// Two ways of putting cores to work on TestDSP, measured on the same BRR input:
+//  - One simulation, verilated with --threads N (VTestDSP_MT<N>), so that a single eval is spread
+//    over N threads. The eight voice decoders are the obvious partitions.
+//  - N independent single threaded simulations running side by side, as RegressionRunner does.
+// Renders from the multithreaded models must match the single threaded one exactly.
+
+double global_time = 0;
+
+double sc_time_stamp()
+{
+  return global_time;
+}
+
+struct Options
+{
+  const char *path = "test_data/13_piano.brr";
+  unsigned seconds = 5;
+};
+
+struct Timing
+{
+  u64 ticks = 0;
+  double seconds = 0;
+};
+
+template <class Module>
+Timing time_render(BasicBench<Module> &bench, const Options &options, const RAM &ram, WaveRecorder &recorder)
+{
+  bench.attach_ram(ram.raw());
+  bench.reset();
+  dsp_write_test_registers(bench);
+
+  const auto start = std::chrono::steady_clock::now();
+  dsp_render(bench, ram, DSP_AUDIO_RATE * options.seconds, recorder);
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return {bench.time(), elapsed.count()};
+}
+
+// One simulation of a model verilated with --threads 'num_threads', in a context with that many
+// threads.
+template <class Module>
+Timing time_threaded(unsigned num_threads, const Options &options, const RAM &ram, WaveRecorder &recorder)
+{
+  VerilatedContext context;
+  context.threads(num_threads);
+  BasicBench<Module> bench(&context);
+  return time_render(bench, options, ram, recorder);
+}
+
+// 'num_sims' single threaded simulations, each on its own thread. Ticks are summed over all of
+// them, and the time is the wall time until the last one finishes.
+Timing time_instances(unsigned num_sims, const Options &options, const RAM &ram)
+{
+  std::vector<u64> ticks(num_sims);
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> sims;
+  for (unsigned i = 0; i < num_sims; ++i)
+  {
+    sims.emplace_back([&, i]()
+                      {
+                        BasicBench<VTestDSP> bench;
+                        WaveRecorder recorder;
+                        ticks[i] = time_render(bench, options, ram, recorder).ticks;
+                      });
+  }
+  for (std::thread &sim : sims)
+    sim.join();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  Timing timing;
+  for (u64 t : ticks)
+    timing.ticks += t;
+  timing.seconds = elapsed.count();
+  return timing;
+}
+
+bool same_render(const WaveRecorder &a, const WaveRecorder &b)
+{
+  return a.num_frames() == b.num_frames() && !memcmp(a.samples(), b.samples(), a.num_frames() * 2 * sizeof(s16));
+}
+
+void print_row(unsigned n, const Timing &timing, const Timing &baseline)
+{
+  const double ticks_per_sec = timing.ticks / timing.seconds;
+  printf("%4u %12.0f ticks/sec %6.2fx\n", n, ticks_per_sec, ticks_per_sec / (baseline.ticks / baseline.seconds));
+}
+
+bool parse_options(int argc, char **argv, Options *options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    if (!strncmp(arg, "--seconds=", 10))
+      options->seconds = atoi(arg + 10);
+    else if (arg[0] == '-')
+      return false;
+    else if (arg[0] != '+')
+      options->path = arg;
+  }
+  return options->seconds > 0;
+}
+
+int main(int argc, char **argv, char **env)
+{
+  Verilated::commandArgs(argc, argv);
+
+  Options options;
+  if (!parse_options(argc, argv, &options))
+  {
+    printf("Usage: %s [--seconds=N] [brr_file_path]\n", argv[0]);
+    exit(1);
+  }
+
+  RAM ram;
+  if (!ram.load(options.path))
+  {
+    printf("Could not load %s\n", options.path);
+    exit(1);
+  }
+
+  printf("Host has %u hardware threads\n", std::thread::hardware_concurrency());
+
+  WaveRecorder renders[4];
+  Timing threaded[4];
+  {
+    BasicBench<VTestDSP> bench;
+    threaded[0] = time_render(bench, options, ram, renders[0]);
+  }
+  threaded[1] = time_threaded<VTestDSP_MT2>(2, options, ram, renders[1]);
+  threaded[2] = time_threaded<VTestDSP_MT4>(4, options, ram, renders[2]);
+  threaded[3] = time_threaded<VTestDSP_MT8>(8, options, ram, renders[3]);
+
+  const unsigned counts[4] = {1, 2, 4, 8};
+  printf("\nOne simulation, --threads N\n");
+  for (unsigned i = 0; i < 4; ++i)
+    print_row(counts[i], threaded[i], threaded[0]);
+
+  printf("\nN single threaded simulations\n");
+  for (unsigned i = 0; i < 4; ++i)
+    print_row(counts[i], time_instances(counts[i], options, ram), threaded[0]);
+
+  for (unsigned i = 1; i < 4; ++i)
+  {
+    if (!same_render(renders[0], renders[i]))
+    {
+      printf("FAIL: --threads %u render differs from the single threaded one\n", counts[i]);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+'''
+Builds TestDSP and DSPVoiceDecoder under several verilator/compiler configurations, renders the
+same 5 second sample through each with RegressionRunner, and prints a ticks/sec table.
+
+Every configuration gets its own build directory under build/flag-matrix/, so they can be rebuilt
+and rerun independently. PGO configurations are built twice in the same directory: once
+instrumented, trained on the render itself, then again using the profile.
+
+  python3 tools/flag_matrix.py [--only=name,...] [--runs=N] [--jobs=N] [brr_file]
+'''
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+X_FAST = '--x-assign fast --x-initial fast'
+
+# name, C++ optimization flags, extra verilator flags, DEBUG_DSP, PGO
+CONFIGS = [
+  ('default',              '',       '',     True,  False),
+  ('O3',                   '-O3',    '',     True,  False),
+  ('Ofast',                '-Ofast', '',     True,  False),
+  ('O3-xfast',             '-O3',    X_FAST, True,  False),
+  ('O3-nodebug',           '-O3',    '',     False, False),
+  ('O3-xfast-nodebug',     '-O3',    X_FAST, False, False),
+  ('Ofast-xfast-nodebug',  '-Ofast', X_FAST, False, False),
+  ('O3-xfast-nodebug-pgo', '-O3',    X_FAST, False, True),
+]
+
+MODELS = ['dsp', 'voice']
+THROUGHPUT = re.compile(r'Throughput: (\d+) ticks/sec')
+
+
+def make(build_dir, opt_flags, verilator_flags, debug_dsp, jobs):
+  subprocess.run([
+    'make', f'-j{jobs}', f'BUILD={build_dir}',
+    f'OPT_FLAGS={opt_flags}',
+    f'EXTRA_VERILATOR_FLAGS={verilator_flags}',
+    f'DEBUG_DSP={1 if debug_dsp else 0}',
+    f'{build_dir}/RegressionRunner',
+  ], check=True, stdout=subprocess.DEVNULL)
+
+
+def render(build_dir, model, brr_file):
+  '''Ticks/sec of one render of 'brr_file' through 'model' (dsp or voice)'''
+  out = subprocess.run(
+    [f'{build_dir}/RegressionRunner', f'--model={model}', '--jobs=1', '--seconds=5', brr_file],
+    check=True, capture_output=True, text=True).stdout
+  match = THROUGHPUT.search(out)
+  if not match:
+    sys.exit(f'No throughput in RegressionRunner output:\n{out}')
+  return int(match.group(1))
+
+
+def remove_objects(build_dir):
+  '''Drops everything compiled, but keeps the verilated sources, so the next make only recompiles'''
+  for pattern in ['*.o', '*.a', 'build-*/*.o', 'RegressionRunner']:
+    for path in glob.glob(os.path.join(build_dir, pattern)):
+      os.remove(path)
+
+
+def build(name, opt_flags, verilator_flags, debug_dsp, pgo, brr_file, jobs):
+  build_dir = os.path.join('build', 'flag-matrix', name)
+  if not pgo:
+    make(build_dir, opt_flags, verilator_flags, debug_dsp, jobs)
+    return build_dir
+
+  # The profile is keyed on object paths, so the instrumented and final builds share a directory.
+  profile_dir = os.path.abspath(os.path.join(build_dir, 'profile'))
+  shutil.rmtree(profile_dir, ignore_errors=True)
+  remove_objects(build_dir)
+  make(build_dir, f'{opt_flags} -fprofile-generate={profile_dir}', verilator_flags, debug_dsp, jobs)
+  for model in MODELS:
+    render(build_dir, model, brr_file)
+  remove_objects(build_dir)
+  make(build_dir, f'{opt_flags} -fprofile-use={profile_dir} -fprofile-partial-training -Wno-missing-profile',
+       verilator_flags, debug_dsp, jobs)
+  return build_dir
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('brr_file', nargs='?', default='test_data/13_piano.brr')
+  parser.add_argument('--only', help='Comma separated configuration names')
+  parser.add_argument('--runs', type=int, default=3, help='Renders per model, the fastest is reported')
+  parser.add_argument('--jobs', type=int, default=os.cpu_count(), help='Parallel make jobs')
+  args = parser.parse_args()
+
+  configs = CONFIGS
+  if args.only:
+    names = args.only.split(',')
+    configs = [c for c in CONFIGS if c[0] in names]
+    if not configs:
+      sys.exit(f'No configurations named {args.only}')
+
+  results = []
+  for name, opt_flags, verilator_flags, debug_dsp, pgo in configs:
+    print(f'Building {name}...', flush=True)
+    build_dir = build(name, opt_flags, verilator_flags, debug_dsp, pgo, args.brr_file, args.jobs)
+    results.append((name, [max(render(build_dir, model, args.brr_file) for _ in range(args.runs)) for model in MODELS]))
+
+  baseline = results[0][1]
+  print()
+  print(f'{"configuration":<24} {"TestDSP ticks/sec":>20} {"DSPVoiceDecoder ticks/sec":>28}')
+  for name, ticks_per_sec in results:
+    cells = [f'{t:>12} ({t / b:5.2f}x)' for t, b in zip(ticks_per_sec, baseline)]
+    print(f'{name:<24} {cells[0]:>20} {cells[1]:>28}')
+
+
+if __name__ == '__main__':
+  main()